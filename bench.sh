@@ -0,0 +1,75 @@
+#!/bin/sh
+#-------------------------------------------------------------------------------
+
+#	bench.sh - compares the pruning policies on a set of files
+#
+#	usage: ./bench.sh [-m MAXBITS] [-p WINDOW] FILE...
+#
+#	Encodes and decodes each FILE with every pruning policy (-P), checks that
+#	it decodes to the original, and prints the compressed size, the ratio of
+#	compressed to original size, and the encode and decode throughput. Run
+#	make first; encode and decode are taken from the current directory.
+
+#-------------------------------------------------------------------------------
+
+MAXBITS=12
+WINDOW=1000
+POLICIES="lru lfu freeze reset"
+
+while getopts m:p: opt; do
+	case $opt in
+		m) MAXBITS=$OPTARG ;;
+		p) WINDOW=$OPTARG ;;
+		*) echo "usage: $0 [-m MAXBITS] [-p WINDOW] FILE..." >&2; exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -eq 0 ]; then
+	echo "usage: $0 [-m MAXBITS] [-p WINDOW] FILE..." >&2
+	exit 1
+fi
+
+TMP=${TMPDIR:-/tmp}/lzwbench.$$
+trap 'rm -f $TMP.enc $TMP.dec' EXIT
+
+# prints the current time in nanoseconds
+now() {
+	date +%s%N
+}
+
+# prints MB/s for $1 bytes in $2 nanoseconds
+rate() {
+	awk -v b="$1" -v ns="$2" 'BEGIN { printf "%.1f", (ns > 0) ? b * 1000 / ns : 0 }'
+}
+
+printf "%-24s %-7s %10s %7s %10s %10s\n" \
+	FILE POLICY BYTES RATIO "ENC MB/s" "DEC MB/s"
+
+for file in "$@"; do
+	size=$(wc -c < "$file")
+
+	for policy in $POLICIES; do
+		case $policy in
+			lru|lfu) args="-m $MAXBITS -p $WINDOW -P $policy" ;;
+			*) args="-m $MAXBITS -P $policy" ;;
+		esac
+
+		start=$(now)
+		./encode $args < "$file" > $TMP.enc
+		mid=$(now)
+		./decode < $TMP.enc > $TMP.dec
+		end=$(now)
+
+		if ! cmp -s "$file" $TMP.dec; then
+			echo "$file: $policy did not decode correctly" >&2
+			exit 1
+		fi
+
+		encSize=$(wc -c < $TMP.enc)
+		printf "%-24s %-7s %10d %7s %10s %10s\n" \
+			"$(basename "$file")" $policy $encSize \
+			"$(awk -v e=$encSize -v s=$size 'BEGIN { printf "%.3f", (s > 0) ? e / s : 0 }')" \
+			"$(rate $size $((mid - start)))" "$(rate $size $((end - mid)))"
+	done
+done
@@ -4,11 +4,30 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "code.h"
+#include "trace.h"
 
 // Information shared by putBits() and flushBits()
 static int nExtra = 0;                  // #bits from previous byte(s)
-static unsigned int extraBits = 0;      // Extra bits from previous byte(s)
+static unsigned long long extraBits = 0; // Extra bits from previous byte(s)
+
+// Chars are packed into outBuf and written to standard output OUT_BUF_SIZE at
+// a time
+#define OUT_BUF_SIZE (1 << 16)
+
+static unsigned char outBuf[OUT_BUF_SIZE];
+static size_t outLen = 0;               // #chars in outBuf
+
+// Write the chars in outBuf to standard output
+static void flushOut (void)
+{
+    unsigned long long begin = traceBegin();
+
+    fwrite (outBuf, 1, outLen, stdout);
+    outLen = 0;
+    traceEnd (TRACE_WRITE, begin);
+}
 
 
 // == PUTBITS MODULE =======================================================
@@ -21,14 +40,16 @@ void putBits (int nBits, int code)
     if (nBits > MAXnBits)
 	exit (fprintf (stderr, "putBits: nBits = %d too large\n", nBits));
 
-    code &= (1 << nBits) - 1;                   // Clear high-order bits
     nExtra += nBits;                            // Add new bits to extraBits
-    extraBits = (extraBits << nBits) | code;
+    extraBits = (extraBits << nBits)            //  (clearing high-order bits)
+	      | ((unsigned)code & ((1ULL << nBits) - 1));
     while (nExtra >= CHAR_BIT) {                // Output any whole chars
 	nExtra -= CHAR_BIT;                     //  and save remaining bits
 	c = extraBits >> nExtra;
-	putchar (c);
-	extraBits ^= c << nExtra;
+	if (outLen == OUT_BUF_SIZE)
+	    flushOut ();
+	outBuf[outLen++] = c;
+	extraBits ^= (unsigned long long)c << nExtra;
     }
 }
 
@@ -36,31 +57,202 @@ void putBits (int nBits, int code)
 void flushBits (void)
 {
     if (nExtra != 0)
-	putchar (extraBits << (CHAR_BIT - nExtra));
+	putBits (CHAR_BIT - nExtra, 0);
+    flushOut ();
+}
+
+// Pad extra bits with zeros to a whole char, then write LEN chars from BUF
+void putBytes (const unsigned char *buf, size_t len)
+{
+    unsigned long long begin;
+
+    if (nExtra != 0)
+	putBits (CHAR_BIT - nExtra, 0);
+    flushOut ();
+    begin = traceBegin();
+    fwrite (buf, 1, len, stdout);
+    traceEnd (TRACE_WRITE, begin);
 }
 
 
 // == GETBITS MODULE =======================================================
 
+// Standard input is read IN_BUF_SIZE chars at a time into inBuf, from which
+// getBits() and getCodes() take codes as readBits() and readCodes() would
+#define IN_BUF_SIZE (1 << 16)
+
+static unsigned char inBuf[IN_BUF_SIZE];
+static bitReader stdIn = {inBuf, inBuf, 0, 0};
+
+static size_t unpackCodes (bitReader *in, int nBits, int stop,
+			   int *codes, size_t max);
+
+// Refill inBuf from standard input once every char in it has been used;
+// return #chars read
+static size_t fillIn (void)
+{
+    unsigned long long begin = traceBegin();
+    size_t len = fread (inBuf, 1, IN_BUF_SIZE, stdin);
+
+    stdIn.next = inBuf;
+    stdIn.end = inBuf + len;
+    traceEnd (TRACE_READ, begin);
+    return len;
+}
+
 // Return next code (#bits = NBITS) from input stream or EOF on end-of-file
 int getBits (int nBits)
 {
     int c;
-    static int nExtra = 0;          // #bits from previous byte(s)
-    static int unsigned extra = 0;  // Extra bits from previous byte(s)
-									      
-    if (nBits > (sizeof(extra)-1) * CHAR_BIT)
+
+    if (nBits > MAXnBits)
 	exit (fprintf (stderr, "getBits: nBits = %d too large\n", nBits));
 
-    // Read enough new bytes to have at least nBits bits to extract code
-    while (nExtra < nBits) {
-	if ((c = getchar()) == EOF)
+    while ((c = readBits (&stdIn, nBits)) == EOF)   // Bits read so far are
+	if (fillIn() == 0)                          //  kept in stdIn
 	    return EOF;                         // Return EOF on end-of-file
-	nExtra += CHAR_BIT;
-	extra = (extra << CHAR_BIT) | c;
+    return c;
+}
+
+// Unpack codes from input stream into CODES as readCodes() does
+size_t getCodes (int nBits, int stop, int *codes, size_t max)
+{
+    size_t n = 0;
+
+    if (nBits > MAXnBits)
+	exit (fprintf (stderr, "getCodes: nBits = %d too large\n", nBits));
+
+    while ((n += unpackCodes (&stdIn, nBits, stop, codes + n, max - n)) < max
+	   && (n == 0 || codes[n-1] >= stop)) {
+	if (fillIn() == 0) {                    // Store EOF on end-of-file
+	    codes[n++] = EOF;
+	    break;
+	}
     }
-    nExtra -= nBits;                            // Return nBits bits
-    c = extra >> nExtra;
-    extra ^= c << nExtra;                       // Save remainder
+    return n;
+}
+
+// Discard extra bits short of a whole char, then read up to LEN chars into
+// BUF; return #chars read
+size_t getBytes (unsigned char *buf, size_t len)
+{
+    size_t n = readBytes (&stdIn, buf, len);    // Use chars saved in inBuf
+    unsigned long long begin = traceBegin();
+
+    n += fread (buf + n, 1, len - n, stdin);
+    traceEnd (TRACE_READ, begin);
+    return n;
+}
+
+
+// == READBITS MODULE ======================================================
+
+// Start reading codes from the LEN bytes at BUF
+void initBits (bitReader *in, const unsigned char *buf, size_t len)
+{
+    in->next = buf;
+    in->end = buf + len;
+    in->nExtra = 0;
+    in->extra = 0;
+}
+
+// Return next code (#bits = NBITS) from IN or EOF on end of buffer
+int readBits (bitReader *in, int nBits)
+{
+    int c;
+
+    if (nBits > MAXnBits)
+	exit (fprintf (stderr, "readBits: nBits = %d too large\n", nBits));
+
+    // Read enough new bytes to have at least nBits bits to extract code
+    while (in->nExtra < nBits) {
+	if (in->next == in->end)
+	    return EOF;                         // Return EOF on end of buffer
+	in->nExtra += CHAR_BIT;
+	in->extra = (in->extra << CHAR_BIT) | *in->next++;
+    }
+    in->nExtra -= nBits;                        // Return nBits bits
+    c = in->extra >> in->nExtra;
+    in->extra ^= (unsigned long long)c << in->nExtra;   // Save remainder
     return c;
 }
+
+// Unpack codes (#bits = NBITS) from IN into CODES until MAX codes have been
+// unpacked, one less than STOP has been, or IN runs out; return #codes
+// [While 8 or more chars are left, they are loaded a word at a time.]
+static size_t unpackCodes (bitReader *in, int nBits, int stop,
+			   int *codes, size_t max)
+{
+    const unsigned char *next = in->next;
+    int nExtra = in->nExtra;
+    unsigned long long extra = in->extra;
+    unsigned long long mask = (1ULL << nBits) - 1;
+    size_t n = 0;
+
+    while (n < max) {
+	if (nExtra < nBits) {                   // Need more bits
+	    if (in->end - next >= 8) {          // Add as many whole chars of
+		unsigned long long word = 0;    //  the next 8 as fit
+		int nChars = (63 - nExtra) / CHAR_BIT;
+		for (int i = 0; i < 8; i++)
+		    word = (word << CHAR_BIT) | next[i];
+		extra = (extra << (nChars * CHAR_BIT))
+		      | (word >> (64 - nChars * CHAR_BIT));
+		nExtra += nChars * CHAR_BIT;
+		next += nChars;
+	    } else {
+		while (nExtra < nBits && next < in->end) {
+		    nExtra += CHAR_BIT;
+		    extra = (extra << CHAR_BIT) | *next++;
+		}
+		if (nExtra < nBits)
+		    break;                      // Out of chars
+	    }
+	}
+	nExtra -= nBits;                        // Unpack nBits bits
+	codes[n] = (extra >> nExtra) & mask;
+	if (codes[n++] < stop)
+	    break;
+    }
+
+    in->next = next;
+    in->nExtra = nExtra;
+    in->extra = extra & ((1ULL << nExtra) - 1); // Clear high-order bits
+    return n;
+}
+
+// Unpack codes (#bits = NBITS) from IN into CODES until MAX codes have been
+// unpacked or one less than STOP has been; return #codes
+// [On end of buffer, EOF is stored as the last code.]
+size_t readCodes (bitReader *in, int nBits, int stop, int *codes, size_t max)
+{
+    size_t n;
+
+    if (nBits > MAXnBits)
+	exit (fprintf (stderr, "readCodes: nBits = %d too large\n", nBits));
+
+    n = unpackCodes (in, nBits, stop, codes, max);
+    if (n < max && (n == 0 || codes[n-1] >= stop))
+	codes[n++] = EOF;                       // Store EOF on end of buffer
+    return n;
+}
+
+// Discard extra bits short of a whole char, then copy up to LEN chars from IN
+// into BUF; return #chars copied
+size_t readBytes (bitReader *in, unsigned char *buf, size_t len)
+{
+    size_t n = 0;
+
+    in->nExtra -= in->nExtra % CHAR_BIT;        // Discard partial char
+    in->extra &= (1ULL << in->nExtra) - 1;
+    while (in->nExtra > 0 && n < len) {         // Use whole chars saved
+	in->nExtra -= CHAR_BIT;
+	buf[n] = in->extra >> in->nExtra;
+	in->extra ^= (unsigned long long)buf[n++] << in->nExtra;
+    }
+    if (len - n > (size_t)(in->end - in->next))
+	len = n + (in->end - in->next);
+    memcpy (buf + n, in->next, len - n);
+    in->next += len - n;
+    return len;
+}
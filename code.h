@@ -2,17 +2,60 @@
 //
 // Interface to putBits/getBits
 
+#ifndef CODE_H
+#define CODE_H
+
 #include <limits.h>
+#include <stddef.h>
 
-#define MAXnBits ((sizeof(int)-1) * CHAR_BIT)   // Upper bound on NBITS
+#define MAXnBits (sizeof(int) * CHAR_BIT - 1)   // Upper bound on NBITS
 
 // Write code (#bits = nBits) to standard output.
-// [Since bits are written as CHAR_BIT-bit characters, any extra bits are
-//  saved, so that final call must be followed by call to flushBits().]
+// [Since bits are written as CHAR_BIT-bit characters, and characters a buffer
+//  at a time, any extra bits and characters are saved, so that final call must
+//  be followed by call to flushBits().]
 void putBits (int nBits, int code);
 
-// Flush any extra bits to standard output
+// Flush any extra bits and characters to standard output
 void flushBits (void);
 
 // Return next code (#bits = nBits) from standard input (EOF on end-of-file)
 int getBits (int nBits);
+
+// Unpack codes (#bits = nBits) from standard input into CODES until MAX codes
+// have been unpacked or one less than STOP has been; return #codes
+// [On end-of-file, EOF is stored as the last code.]
+size_t getCodes (int nBits, int stop, int *codes, size_t max);
+
+// Write LEN chars from BUF to standard output, starting at a char boundary
+// [Any extra bits are first padded with zeros to a whole char.]
+void putBytes (const unsigned char *buf, size_t len);
+
+// Read up to LEN chars into BUF from standard input, starting at a char
+// boundary; return #chars read
+// [Any extra bits short of a whole char are discarded first.]
+size_t getBytes (unsigned char *buf, size_t len);
+
+// State for reading codes from a buffer in memory instead of standard input,
+// so that any number of streams can be read at once
+typedef struct {
+    const unsigned char *next;          // Next unread byte of buffer
+    const unsigned char *end;           // One past last byte of buffer
+    int nExtra;                         // #bits from previous byte(s)
+    unsigned long long extra;           // Extra bits from previous byte(s)
+} bitReader;
+
+// Start reading codes from the LEN bytes at BUF
+void initBits (bitReader *in, const unsigned char *buf, size_t len);
+
+// Return next code (#bits = nBits) from IN (EOF on end of buffer)
+int readBits (bitReader *in, int nBits);
+
+// Unpack codes (#bits = nBits) from IN into CODES as getCodes() does
+size_t readCodes (bitReader *in, int nBits, int stop, int *codes, size_t max);
+
+// Copy up to LEN chars from IN into BUF, starting at a char boundary as with
+// getBytes; return #chars copied
+size_t readBytes (bitReader *in, unsigned char *buf, size_t len);
+
+#endif
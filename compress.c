@@ -0,0 +1,520 @@
+/* 
+ * File:   compress.c
+ * Author: Alexander Schurman (alexander.schurman@yale.edu)
+ * 
+ * Created on October 18, 2026
+ * 
+ * Implementation of the compress format as described in compress.h, on the
+ * string table encode and decode use. The table's first code is left unused,
+ * so that the strings compress numbers from 257 up keep their numbers there;
+ * the single characters, which compress numbers from 0, are one higher. (In
+ * the old non-block mode, without CLEAR, the strings are numbered from 256,
+ * so every code is one higher.)
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "compress.h"
+#include "stringTable.h"
+#include "trace.h"
+#include "mem.h"
+
+#define Z_MAGIC_0 (0x1F) // the first two bytes of every stream
+#define Z_MAGIC_1 (0x9D)
+#define Z_BITS_MASK (0x1F) // the bits of the third byte that give maxBits
+#define Z_BLOCK_MODE (0x80) // the flag in the third byte for block mode
+
+#define Z_CLEAR (256) // in block mode, empties the table
+#define Z_FIRST (257) // the first code for a string in block mode
+#define Z_TABLE_FIRST_CODE (1) // the firstCode of the table, see above
+
+// codes are written in groups of Z_GROUP_CODES, which take up as many bytes as
+// the codes have bits. When the width changes, or after CLEAR, what is left of
+// the group is padded out with zeros
+#define Z_GROUP_CODES (8)
+
+// once the table is full, every Z_CHECK_GAP bytes of input the compression
+// ratio so far is checked, and the table cleared if it has fallen
+#define Z_CHECK_GAP (10000)
+
+#define Z_BUFFER_SIZE (1 << 16) // the bytes read or written at a time
+
+// the largest code that fits in Z_MIN_BITS bits, where codes start out (and
+// go back to after CLEAR). Even if maxBits is Z_MIN_BITS, codes widen past it
+// once they reach this, as they do in compress
+#define Z_MIN_MAX_CODE ((1U << Z_MIN_BITS) - 1)
+
+/* returns the largest code that fits in width bits for a stream of maxBits,
+ * once codes have widened to width */
+static inline unsigned int zMaxCode(unsigned int width, unsigned int maxBits)
+{
+    return (width == maxBits) ? (1U << maxBits) : (1U << width) - 1;
+}
+
+bool zDetect()
+{
+    int c = getchar();
+    if(c != EOF)
+    {
+        ungetc(c, stdin);
+    }
+    
+    return c == Z_MAGIC_0;
+}
+
+/*******************************************************************************
+********************************** Encoding ************************************
+*******************************************************************************/
+
+// writes the len bytes at data to stdout
+static void zFlush(const unsigned char* data, size_t len)
+{
+    unsigned long long begin = traceBegin();
+    fwrite(data, 1, len, stdout);
+    traceEnd(TRACE_WRITE, begin);
+}
+
+// writes codes to stdout as compress does
+typedef struct
+{
+    unsigned char out[Z_BUFFER_SIZE];
+    size_t outLen; // the bytes in out not yet written
+    unsigned long long bytesOut; // the bytes written, counting those in out
+    
+    unsigned long long bits; // the bits of codes not yet in out, lowest first
+    unsigned int numBits; // the number of them
+    unsigned int codesInGroup; // the codes written in the current group
+    
+    unsigned int width; // the bits per code
+    unsigned int maxCode; // the largest code that fits in width bits
+    unsigned int maxBits;
+} zWriter;
+
+// moves the whole bytes of w->bits into w->out, writing it out when it fills
+static inline void zWriterDrain(zWriter* w)
+{
+    while(w->numBits >= 8)
+    {
+        w->out[w->outLen++] = (unsigned char)w->bits;
+        w->bits >>= 8;
+        w->numBits -= 8;
+        
+        if(w->outLen == Z_BUFFER_SIZE)
+        {
+            zFlush(w->out, w->outLen);
+            w->outLen = 0;
+        }
+    }
+}
+
+/* writes code, then, if nextCode won't fit in the current width or clear is
+ * set (after CLEAR), pads out the group and widens codes or sets them back to
+ * Z_MIN_BITS. nextCode is the next code the table will give out. */
+void zPutCode(zWriter* w, unsigned int code, unsigned int nextCode, bool clear)
+{
+    w->bits |= (unsigned long long)code << w->numBits;
+    w->numBits += w->width;
+    w->codesInGroup = (w->codesInGroup + 1) % Z_GROUP_CODES;
+    w->bytesOut += (w->codesInGroup == 0) ? w->width : 0;
+    zWriterDrain(w);
+    
+    if(nextCode > w->maxCode || clear)
+    {
+        if(w->codesInGroup > 0)
+        {
+            // the padding is zeros, which is what's above numBits already
+            w->numBits += (Z_GROUP_CODES - w->codesInGroup) * w->width;
+            w->bytesOut += w->width;
+            w->codesInGroup = 0;
+            zWriterDrain(w);
+        }
+        
+        w->width = (clear) ? Z_MIN_BITS : w->width + 1;
+        w->maxCode = (clear) ? Z_MIN_MAX_CODE : zMaxCode(w->width, w->maxBits);
+    }
+}
+
+/* returns the compress code for code in the table, which is in block mode */
+static inline unsigned int zCodeFor(unsigned int code)
+{
+    return (code >= Z_FIRST) ? code : code - Z_TABLE_FIRST_CODE;
+}
+
+void zEncode(unsigned int maxBits)
+{
+    static zWriter w; // static for its size
+    w.outLen = 0;
+    w.bits = 0;
+    w.numBits = 0;
+    w.codesInGroup = 0;
+    w.width = Z_MIN_BITS;
+    w.maxBits = maxBits;
+    w.maxCode = Z_MIN_MAX_CODE;
+    
+    // the header
+    w.out[w.outLen++] = Z_MAGIC_0;
+    w.out[w.outLen++] = Z_MAGIC_1;
+    w.out[w.outLen++] = Z_BLOCK_MODE | maxBits;
+    w.bytesOut = w.outLen;
+    
+    stringTable* table = stringTableNew(maxBits, Z_TABLE_FIRST_CODE, false);
+    
+    unsigned long long inCount = 0; // the bytes of input read
+    unsigned long long checkpoint = Z_CHECK_GAP; // when to check the ratio
+    unsigned long long ratio = 0; // the best ratio since the last CLEAR
+    unsigned int c = EMPTY_PREFIX; // the prefix so far
+    
+    unsigned char block[Z_BUFFER_SIZE];
+    size_t len;
+    unsigned long long begin = traceBegin();
+    while((len = fread(block, 1, Z_BUFFER_SIZE, stdin)) > 0)
+    {
+        traceEnd(TRACE_READ, begin);
+        begin = traceBegin();
+        
+        for(size_t i = 0; i < len; i++)
+        {
+            unsigned char k = block[i];
+            inCount++;
+            
+            if(c == EMPTY_PREFIX)
+            {
+                c = k + Z_TABLE_FIRST_CODE;
+                continue;
+            }
+            
+            tableElt* ck = stringTableHashSearch(table, c, k);
+            if(ck)
+            {
+                c = ck->code;
+                continue;
+            }
+            
+            zPutCode(&w, zCodeFor(c), table->highestCode + 1, false);
+            
+            if(!stringTableIsFull(table))
+            {
+                stringTableAdd(table, c, k, NULL);
+            }
+            else if(inCount >= checkpoint)
+            {
+                // the ratio, with 8 fractional bits
+                unsigned long long newRatio = (inCount << 8) / w.bytesOut;
+                
+                checkpoint = inCount + Z_CHECK_GAP;
+                if(newRatio > ratio)
+                {
+                    ratio = newRatio;
+                }
+                else
+                {
+                    ratio = 0;
+                    stringTableReset(table);
+                    zPutCode(&w, Z_CLEAR, Z_FIRST, true);
+                }
+            }
+            
+            c = k + Z_TABLE_FIRST_CODE;
+        }
+        
+        traceEnd(TRACE_CODE, begin);
+        begin = traceBegin();
+    }
+    traceEnd(TRACE_READ, begin);
+    
+    if(c != EMPTY_PREFIX)
+    {
+        zPutCode(&w, zCodeFor(c), table->highestCode + 1, false);
+    }
+    
+    // the last group isn't padded out, only the last byte
+    w.numBits += (8 - w.numBits % 8) % 8;
+    zWriterDrain(&w);
+    zFlush(w.out, w.outLen);
+    fflush(stdout);
+    
+    stringTableDelete(table);
+}
+
+/*******************************************************************************
+********************************** Decoding ************************************
+*******************************************************************************/
+
+// reads codes from stdin as compress does
+typedef struct
+{
+    // stdin read ahead, with room past the end for reading a code as 3 bytes
+    unsigned char in[Z_BUFFER_SIZE + 2];
+    size_t inPos; // the first unread byte of in
+    size_t inLen; // the bytes read into in
+    
+    const unsigned char* group; // the group codes are being read from
+    long groupBits; // codes start before this many bits into group
+    long offset; // where the next code starts, in bits
+    
+    unsigned int width; // the bits per code
+    unsigned int maxCode; // the largest code that fits in width bits
+    unsigned int maxBits;
+} zReader;
+
+/* returns the next code, or EOF if there are no more. nextCode is the next
+ * code the table will give out, which widens codes once it won't fit in the
+ * current width; clear is set after CLEAR, to go back to Z_MIN_BITS, and is
+ * reset. Either starts a new group. */
+int zGetCode(zReader* r, unsigned int nextCode, bool* clear)
+{
+    if(*clear || r->offset >= r->groupBits || nextCode > r->maxCode)
+    {
+        if(nextCode > r->maxCode)
+        {
+            r->width++;
+            r->maxCode = zMaxCode(r->width, r->maxBits);
+        }
+        if(*clear)
+        {
+            r->width = Z_MIN_BITS;
+            r->maxCode = Z_MIN_MAX_CODE;
+            *clear = false;
+        }
+        
+        if(r->inLen - r->inPos < r->width)
+        {
+            r->inLen -= r->inPos;
+            memmove(r->in, &r->in[r->inPos], r->inLen);
+            r->inPos = 0;
+            unsigned long long begin = traceBegin();
+            r->inLen += fread(&r->in[r->inLen],
+                              1,
+                              Z_BUFFER_SIZE - r->inLen,
+                              stdin);
+            traceEnd(TRACE_READ, begin);
+        }
+        
+        size_t groupLen = r->inLen - r->inPos;
+        if(groupLen > r->width)
+        {
+            groupLen = r->width;
+        }
+        
+        r->group = &r->in[r->inPos];
+        r->inPos += groupLen;
+        r->groupBits = (long)groupLen * 8 - (long)(r->width - 1);
+        r->offset = 0;
+        
+        if(r->groupBits <= 0)
+        {
+            return EOF;
+        }
+    }
+    
+    const unsigned char* bytes = &r->group[r->offset >> 3];
+    unsigned long word = bytes[0] | (unsigned long)bytes[1] << 8 |
+                         (unsigned long)bytes[2] << 16;
+    int code = (word >> (r->offset & 7)) & ((1UL << r->width) - 1);
+    r->offset += r->width;
+    
+    return code;
+}
+
+// gathers decoded bytes into blocks for stdout
+typedef struct
+{
+    unsigned char out[Z_BUFFER_SIZE];
+    size_t outLen;
+    bool discard; // true if the bytes are thrown away
+    unsigned long long bytes; // the bytes decoded
+} zOutput;
+
+// writes the len bytes at data
+static inline void zWrite(zOutput* o, const unsigned char* data, size_t len)
+{
+    o->bytes += len;
+    if(o->discard)
+    {
+        return;
+    }
+    
+    if(o->outLen + len > Z_BUFFER_SIZE)
+    {
+        zFlush(o->out, o->outLen);
+        o->outLen = 0;
+        
+        if(len > Z_BUFFER_SIZE)
+        {
+            zFlush(data, len);
+            return;
+        }
+    }
+    
+    memcpy(&o->out[o->outLen], data, len);
+    o->outLen += len;
+}
+
+bool zDecode(decodeStats* stats, bool discard)
+{
+    if(stats)
+    {
+        stats->codes = 0;
+        stats->cacheHits = 0;
+        stats->bytes = 0;
+        stats->checks = 0;
+        stats->overLimit = false;
+    }
+    
+    int magic0 = getchar();
+    int magic1 = getchar();
+    int flags = getchar();
+    if(magic0 != Z_MAGIC_0 || magic1 != Z_MAGIC_1 || flags == EOF ||
+       (flags & Z_BITS_MASK) < Z_MIN_BITS || (flags & Z_BITS_MASK) > Z_MAX_BITS)
+    {
+        return false;
+    }
+    
+    unsigned int maxBits = flags & Z_BITS_MASK;
+    bool blockMode = (flags & Z_BLOCK_MODE) != 0;
+    
+    // without block mode, the table needs one more code than compress's
+    unsigned int tableBits = maxBits + !blockMode;
+    unsigned int shift = !blockMode; // the table code of a string less its
+                                     // compress code
+    size_t numCodes = (size_t)1 << tableBits;
+    if(stringTableMaxMemory(tableBits, POLICY_FREEZE, false) + numCodes >
+       memAvailable())
+    {
+        if(stats) stats->overLimit = true;
+        return false;
+    }
+    
+    static zReader r; // static for its size
+    memset(r.in, 0, sizeof(r.in));
+    r.inPos = 0;
+    r.inLen = 0;
+    r.groupBits = 0;
+    r.offset = 0;
+    r.width = Z_MIN_BITS;
+    r.maxBits = maxBits;
+    r.maxCode = Z_MIN_MAX_CODE;
+    
+    static zOutput o;
+    o.outLen = 0;
+    o.discard = discard;
+    o.bytes = 0;
+    
+    stringTable* table = stringTableNew(tableBits, Z_TABLE_FIRST_CODE, false);
+    tableElt* array = table->array;
+    unsigned int maxCode = 1U << maxBits; // compress gives out codes below this
+    unsigned int nextCode = (blockMode) ? Z_FIRST : Z_CLEAR;
+    
+    // the strings are spelled backwards from the end of str
+    unsigned char* str = memAlloc(numCodes + 1);
+    unsigned long long codes = 0;
+    bool clear = false;
+    bool ok = true;
+    
+    int code = zGetCode(&r, nextCode, &clear);
+    unsigned int oldCode = 0; // the table code of the last code
+    unsigned char finalK = 0; // the first character of its string
+    if(code != EOF)
+    {
+        if(code >= Z_CLEAR)
+        {
+            ok = false;
+        }
+        else
+        {
+            finalK = code;
+            oldCode = code + Z_TABLE_FIRST_CODE;
+            zWrite(&o, &finalK, 1);
+            codes++;
+        }
+    }
+    
+    while(ok && code != EOF && (code = zGetCode(&r, nextCode, &clear)) != EOF)
+    {
+        if(code == Z_CLEAR && blockMode)
+        {
+            stringTableReset(table);
+            array = table->array;
+            clear = true;
+            nextCode = Z_CLEAR; // a code no string gets, given out next
+            
+            // the table is empty, so what follows has to be a character
+            code = zGetCode(&r, nextCode, &clear);
+            if(code == EOF)
+            {
+                break;
+            }
+            else if(code >= Z_CLEAR)
+            {
+                ok = false;
+                break;
+            }
+        }
+        codes++;
+        
+        size_t pos = numCodes + 1;
+        unsigned int tableCode;
+        if((unsigned int)code < nextCode)
+        {
+            tableCode = (code < Z_CLEAR) ? code + Z_TABLE_FIRST_CODE
+                                         : code + shift;
+        }
+        else if((unsigned int)code == nextCode && nextCode < maxCode &&
+                !(blockMode && nextCode == Z_CLEAR))
+        {
+            // the string of the code being added: the last string and its
+            // own first character
+            str[--pos] = finalK;
+            tableCode = oldCode;
+        }
+        else
+        {
+            ok = false;
+            break;
+        }
+        
+        unsigned int newCode = (pos == numCodes + 1) ? tableCode
+                                                     : table->highestCode + 1;
+        while(array[tableCode].prefix != EMPTY_PREFIX)
+        {
+            str[--pos] = array[tableCode].k;
+            tableCode = array[tableCode].prefix;
+        }
+        str[--pos] = finalK = array[tableCode].k;
+        zWrite(&o, &str[pos], numCodes + 1 - pos);
+        
+        if(nextCode < maxCode)
+        {
+            // the code given out right after CLEAR is CLEAR's own, and holds
+            // nothing
+            // compress never gives out a string that is in the table already,
+            // so a stream that asks for one is corrupt
+            if(!(blockMode && nextCode == Z_CLEAR) &&
+               !stringTableAdd(table, oldCode, finalK, NULL))
+            {
+                ok = false;
+                break;
+            }
+            array = table->array;
+            nextCode++;
+        }
+        oldCode = newCode;
+    }
+    
+    if(!discard)
+    {
+        zFlush(o.out, o.outLen);
+        fflush(stdout);
+    }
+    
+    if(stats)
+    {
+        stats->codes = codes;
+        stats->bytes = o.bytes;
+    }
+    
+    memFree(str);
+    stringTableDelete(table);
+    return ok;
+}
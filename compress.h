@@ -0,0 +1,38 @@
+/* 
+ * File:   compress.h
+ * Author: Alexander Schurman
+ * 
+ * Created on October 18, 2026
+ * 
+ * Interface for reading and writing the format of the Unix compress utility
+ * (.Z files): LZW with codes of 9 up to 16 bits, written least significant bit
+ * first in groups of 8, and a CLEAR code that empties the table.
+ */
+
+#include <stdbool.h>
+#include "lzw.h"
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+// the range of maxBits compress allows
+#define Z_MIN_BITS (9)
+#define Z_MAX_BITS (16)
+
+/* returns true if stdin starts with the magic number of the compress format,
+ * without consuming any of it. Streams written by encode never do. */
+bool zDetect();
+
+/* encodes stdin into stdout in the compress format, in block mode (emptying
+ * the table whenever the compression ratio falls, as compress does), with codes
+ * of up to maxBits bits. maxBits must be in the range [Z_MIN_BITS, Z_MAX_BITS].
+ */
+void zEncode(unsigned int maxBits);
+
+/* decodes the compress stream on stdin into stdout, or throws it away if
+ * discard, filling in stats unless it is NULL. Returns true if successful,
+ * false if stdin is an invalid stream or, under a memory limit (see mem.h),
+ * one too big to decode, in which case stats->overLimit is set. */
+bool zDecode(decodeStats* stats, bool discard);
+
+#endif
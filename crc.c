@@ -0,0 +1,130 @@
+/* 
+ * File:   crc.c
+ * Author: Alexander Schurman (alexander.schurman@yale.edu)
+ * 
+ * Created on October 18, 2026
+ * 
+ * Implementation of crc32c as described in crc.h. On x86-64 processors with
+ * SSE4.2, the CRC32 instruction does 8 bytes at a time; elsewhere, 8 tables of
+ * 256 entries do the same in software ("slicing-by-8"). Both give the same
+ * results.
+ */
+
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "crc.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CRC_HARDWARE
+#include <nmmintrin.h>
+#endif
+
+#define CRC_POLY (0x82F63B78U) // the Castagnoli polynomial, bit-reversed
+#define CRC_SLICES (8) // the bytes done at a time by the software version
+
+// crcTable[j][b] is the CRC of byte b followed by j zero bytes
+static uint32_t crcTable[CRC_SLICES][1 << 8];
+static bool crcHardwareAvailable = false; // true if the processor has CRC32
+static pthread_once_t crcOnce = PTHREAD_ONCE_INIT;
+
+// fills in crcTable and crcHardwareAvailable
+void crcInit()
+{
+#ifdef CRC_HARDWARE
+    __builtin_cpu_init();
+    crcHardwareAvailable = __builtin_cpu_supports("sse4.2") != 0;
+#endif
+    
+    for(unsigned int b = 0; b < (1 << 8); b++)
+    {
+        uint32_t crc = b;
+        for(int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC_POLY : crc >> 1;
+        }
+        crcTable[0][b] = crc;
+    }
+    
+    for(unsigned int b = 0; b < (1 << 8); b++)
+    {
+        for(int j = 1; j < CRC_SLICES; j++)
+        {
+            uint32_t prev = crcTable[j - 1][b];
+            crcTable[j][b] = (prev >> 8) ^ crcTable[0][prev & 0xFF];
+        }
+    }
+}
+
+/* the software version of crc32c, on the CRC register rather than the CRC.
+ * Assumes a little-endian processor for the 8 bytes at a time; the rest is
+ * done a byte at a time */
+uint32_t crcSoftware(uint32_t crc, const unsigned char* buf, size_t len)
+{
+    size_t i = 0;
+    
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for(; i + CRC_SLICES <= len; i += CRC_SLICES)
+    {
+        uint32_t low, high;
+        memcpy(&low, &buf[i], sizeof(low));
+        memcpy(&high, &buf[i + sizeof(low)], sizeof(high));
+        low ^= crc;
+        
+        crc = crcTable[7][low & 0xFF] ^
+              crcTable[6][(low >> 8) & 0xFF] ^
+              crcTable[5][(low >> 16) & 0xFF] ^
+              crcTable[4][low >> 24] ^
+              crcTable[3][high & 0xFF] ^
+              crcTable[2][(high >> 8) & 0xFF] ^
+              crcTable[1][(high >> 16) & 0xFF] ^
+              crcTable[0][high >> 24];
+    }
+#endif
+    
+    for(; i < len; i++)
+    {
+        crc = (crc >> 8) ^ crcTable[0][(crc ^ buf[i]) & 0xFF];
+    }
+    
+    return crc;
+}
+
+#ifdef CRC_HARDWARE
+// the SSE4.2 version of crcSoftware
+__attribute__((target("sse4.2")))
+uint32_t crcHardware(uint32_t crc, const unsigned char* buf, size_t len)
+{
+    uint64_t crc64 = crc;
+    size_t i = 0;
+    
+    for(; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, &buf[i], sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (uint32_t)crc64;
+    
+    for(; i < len; i++)
+    {
+        crc = _mm_crc32_u8(crc, buf[i]);
+    }
+    
+    return crc;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const unsigned char* buf, size_t len)
+{
+    pthread_once(&crcOnce, crcInit);
+    
+#ifdef CRC_HARDWARE
+    if(crcHardwareAvailable)
+    {
+        return ~crcHardware(~crc, buf, len);
+    }
+#endif
+    
+    return ~crcSoftware(~crc, buf, len);
+}
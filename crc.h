@@ -0,0 +1,22 @@
+/* 
+ * File:   crc.h
+ * Author: Alexander Schurman
+ * 
+ * Created on October 18, 2026
+ * 
+ * Interface for the CRC-32C (Castagnoli) checksums that encode -k writes after
+ * each block of input and that decode and verify check.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef CRC_H
+#define CRC_H
+
+/* returns the CRC-32C of the len bytes at buf following bytes whose CRC-32C
+ * was crc, so that crc32c(crc32c(0, a, m), b, n) is the CRC-32C of a then b.
+ * Start with crc = 0. Can be called from several threads at once. */
+uint32_t crc32c(uint32_t crc, const unsigned char* buf, size_t len);
+
+#endif
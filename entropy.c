@@ -0,0 +1,332 @@
+/* 
+ * File:   entropy.c
+ * Author: Alexander Schurman (alexander.schurman@yale.edu)
+ *
+ * Created on October 18, 2026
+ * 
+ * Implementation of the entropy coding stage described in entropy.h. The range
+ * coder follows the binary adaptive coder used by LZMA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "code.h"
+#include "entropy.h"
+
+#define TOP_VALUE ((uint32_t)1 << 24) // range is renormalized below this
+#define PROB_BITS (11) // probabilities are fractions of 1 << PROB_BITS
+#define PROB_INIT (1 << (PROB_BITS - 1)) // a probability of one half
+#define MOVE_BITS (5) // how quickly probabilities adapt
+
+/*******************************************************************************
+********************************* Misc. Functions ******************************
+*******************************************************************************/
+
+// sets every probability in model to one half
+void codeModelInit(codeModel* model)
+{
+    uint16_t* probs = (uint16_t*)model;
+    for(size_t i = 0; i < sizeof(codeModel) / sizeof(uint16_t); i++)
+    {
+        probs[i] = PROB_INIT;
+    }
+}
+
+// returns the number of significant bits in code
+unsigned int codeSlot(unsigned int code)
+{
+    unsigned int slot = 0;
+    for(; code; code >>= 1) slot++;
+    return slot;
+}
+
+/* returns the number of bits below the highest set bit of a code in slot that
+ * are modeled */
+unsigned int modeledLowBits(unsigned int slot)
+{
+    return (slot <= MODELED_LOW_BITS + 1) ? slot - 1 : MODELED_LOW_BITS;
+}
+
+
+/*******************************************************************************
+********************************** Encoding ************************************
+*******************************************************************************/
+
+// writes out the top byte of low, holding back bytes that a carry may change
+void shiftLow(entropyEncoder* enc)
+{
+    if((uint32_t)enc->low < 0xFF000000 || (enc->low >> 32) != 0)
+    {
+        unsigned char carry = enc->low >> 32;
+        unsigned char temp = enc->cache;
+        
+        do
+        {
+            putBits(CHAR_BIT, (unsigned char)(temp + carry));
+            temp = 0xFF;
+        } while(--enc->cacheSize != 0);
+        
+        enc->cache = enc->low >> 24;
+    }
+    
+    enc->cacheSize++;
+    enc->low = (enc->low & 0x00FFFFFF) << 8;
+}
+
+// encodes bit with the adaptive probability *prob
+void encodeBit(entropyEncoder* enc, uint16_t* prob, unsigned int bit)
+{
+    uint32_t bound = (enc->range >> PROB_BITS) * *prob;
+    
+    if(bit == 0)
+    {
+        enc->range = bound;
+        *prob += ((1 << PROB_BITS) - *prob) >> MOVE_BITS;
+    }
+    else
+    {
+        enc->low += bound;
+        enc->range -= bound;
+        *prob -= *prob >> MOVE_BITS;
+    }
+    
+    while(enc->range < TOP_VALUE)
+    {
+        enc->range <<= 8;
+        shiftLow(enc);
+    }
+}
+
+// encodes the low nBits of value, highest first, with even probabilities
+void encodeDirect(entropyEncoder* enc, unsigned int value, unsigned int nBits)
+{
+    while(nBits-- > 0)
+    {
+        enc->range >>= 1;
+        if((value >> nBits) & 1)
+        {
+            enc->low += enc->range;
+        }
+        
+        while(enc->range < TOP_VALUE)
+        {
+            enc->range <<= 8;
+            shiftLow(enc);
+        }
+    }
+}
+
+// encodes the low nBits of value, highest first, with the bit tree probs
+void encodeTree(entropyEncoder* enc,
+                uint16_t* probs,
+                unsigned int value,
+                unsigned int nBits)
+{
+    unsigned int node = 1;
+    
+    while(nBits-- > 0)
+    {
+        unsigned int bit = (value >> nBits) & 1;
+        encodeBit(enc, &probs[node], bit);
+        node = (node << 1) | bit;
+    }
+}
+
+entropyEncoder* entropyEncoderNew()
+{
+    entropyEncoder* enc = malloc(sizeof(entropyEncoder));
+    
+    codeModelInit(&enc->model);
+    entropyEncoderRestart(enc);
+    
+    return enc;
+}
+
+void entropyEncoderDelete(entropyEncoder* enc)
+{
+    free(enc);
+}
+
+void entropyEncodeCode(entropyEncoder* enc, unsigned char nbits, unsigned int code)
+{
+    unsigned int slot = codeSlot(code);
+    encodeTree(enc, enc->model.slot[nbits], slot, SLOT_BITS);
+    
+    if(slot > 1)
+    {
+        // the highest set bit is implied by the slot
+        unsigned int lowBits = slot - 1;
+        unsigned int modeled = modeledLowBits(slot);
+        unsigned int direct = lowBits - modeled;
+        
+        encodeTree(enc,
+                   enc->model.low[slot],
+                   (code >> direct) & ((1 << modeled) - 1),
+                   modeled);
+        encodeDirect(enc, code & ((1 << direct) - 1), direct);
+    }
+}
+
+void entropyEncodeChar(entropyEncoder* enc, unsigned char c)
+{
+    encodeTree(enc, enc->model.chars, c, CHAR_BIT);
+}
+
+void entropyEncoderFlush(entropyEncoder* enc)
+{
+    for(int i = 0; i < 5; i++)
+    {
+        shiftLow(enc);
+    }
+}
+
+void entropyEncoderRestart(entropyEncoder* enc)
+{
+    enc->low = 0;
+    enc->range = 0xFFFFFFFF;
+    enc->cache = 0;
+    enc->cacheSize = 1;
+}
+
+
+/*******************************************************************************
+********************************** Decoding ************************************
+*******************************************************************************/
+
+// returns the next byte of dec's stream, or 0 past the end of the stream
+uint32_t nextByte(entropyDecoder* dec)
+{
+    int c = (dec->in) ? readBits(dec->in, CHAR_BIT) : getBits(CHAR_BIT);
+    
+    if(c == EOF)
+    {
+        dec->truncated = true;
+        return 0;
+    }
+    
+    return c;
+}
+
+// decodes a bit with the adaptive probability *prob
+unsigned int decodeBit(entropyDecoder* dec, uint16_t* prob)
+{
+    uint32_t bound = (dec->range >> PROB_BITS) * *prob;
+    unsigned int bit;
+    
+    if(dec->code < bound)
+    {
+        dec->range = bound;
+        *prob += ((1 << PROB_BITS) - *prob) >> MOVE_BITS;
+        bit = 0;
+    }
+    else
+    {
+        dec->code -= bound;
+        dec->range -= bound;
+        *prob -= *prob >> MOVE_BITS;
+        bit = 1;
+    }
+    
+    if(dec->range < TOP_VALUE)
+    {
+        dec->range <<= 8;
+        dec->code = (dec->code << 8) | nextByte(dec);
+    }
+    
+    return bit;
+}
+
+// decodes nBits bits, highest first, that were sent with even probabilities
+unsigned int decodeDirect(entropyDecoder* dec, unsigned int nBits)
+{
+    unsigned int value = 0;
+    
+    while(nBits-- > 0)
+    {
+        dec->range >>= 1;
+        
+        unsigned int bit = (dec->code >= dec->range);
+        if(bit)
+        {
+            dec->code -= dec->range;
+        }
+        value = (value << 1) | bit;
+        
+        if(dec->range < TOP_VALUE)
+        {
+            dec->range <<= 8;
+            dec->code = (dec->code << 8) | nextByte(dec);
+        }
+    }
+    
+    return value;
+}
+
+// decodes nBits bits, highest first, with the bit tree probs
+unsigned int decodeTree(entropyDecoder* dec, uint16_t* probs, unsigned int nBits)
+{
+    unsigned int node = 1;
+    
+    for(unsigned int i = 0; i < nBits; i++)
+    {
+        node = (node << 1) | decodeBit(dec, &probs[node]);
+    }
+    
+    return node - (1 << nBits);
+}
+
+entropyDecoder* entropyDecoderNew(bitReader* in)
+{
+    entropyDecoder* dec = malloc(sizeof(entropyDecoder));
+    
+    codeModelInit(&dec->model);
+    dec->in = in;
+    dec->truncated = false;
+    entropyDecoderRestart(dec);
+    
+    return dec;
+}
+
+void entropyDecoderRestart(entropyDecoder* dec)
+{
+    dec->range = 0xFFFFFFFF;
+    dec->code = 0;
+    
+    // the first byte written by the encoder is always zero
+    for(int i = 0; i < 5; i++)
+    {
+        dec->code = (dec->code << 8) | nextByte(dec);
+    }
+}
+
+void entropyDecoderDelete(entropyDecoder* dec)
+{
+    free(dec);
+}
+
+int entropyDecodeCode(entropyDecoder* dec, unsigned char nbits)
+{
+    unsigned int slot = decodeTree(dec, dec->model.slot[nbits], SLOT_BITS);
+    unsigned int code = (slot > 0) ? 1 : 0;
+    
+    if(slot > 1)
+    {
+        unsigned int lowBits = slot - 1;
+        unsigned int modeled = modeledLowBits(slot);
+        unsigned int direct = lowBits - modeled;
+        
+        code = (code << modeled) | decodeTree(dec, dec->model.low[slot], modeled);
+        code = (code << direct) | decodeDirect(dec, direct);
+    }
+    
+    return (dec->truncated || slot > nbits) ? EOF : (int)code;
+}
+
+int entropyDecodeChar(entropyDecoder* dec)
+{
+    unsigned int c = decodeTree(dec, dec->model.chars, CHAR_BIT);
+    
+    return (dec->truncated) ? EOF : (int)c;
+}
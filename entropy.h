@@ -0,0 +1,100 @@
+/* 
+ * File:   entropy.h
+ * Author: Alexander Schurman
+ *
+ * Created on October 18, 2026
+ * 
+ * Interface for the optional entropy coding stage that sits between the LZW
+ * loop and putBits/getBits. Codes are sent with an adaptive binary range coder:
+ * the number of significant bits in a code (its slot) is modeled separately
+ * for each code width, the bits just below the highest set bit are modeled
+ * separately for each slot, and the remaining low bits are sent as they are.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "code.h"
+
+#ifndef ENTROPY_H
+#define ENTROPY_H
+
+#define SLOT_BITS (5) // enough bits to hold any slot; slots go up to MAXnBits
+#define NUM_SLOTS (1 << SLOT_BITS)
+#define MODELED_LOW_BITS (3) // bits below the highest set bit that are modeled
+
+// the adaptive probabilities shared by entropyEncoder and entropyDecoder
+typedef struct
+{
+    uint16_t slot[NUM_SLOTS][NUM_SLOTS]; // bit tree of slots for each width
+    uint16_t low[NUM_SLOTS][1 << MODELED_LOW_BITS]; // bit tree for each slot
+    uint16_t chars[1 << CHAR_BIT]; // bit tree of escaped characters
+} codeModel;
+
+typedef struct
+{
+    codeModel model;
+    uint64_t low; // low end of the current range
+    uint32_t range; // size of the current range
+    unsigned char cache; // byte that may still be changed by a carry
+    uint64_t cacheSize; // number of pending bytes, counting cache
+} entropyEncoder;
+
+typedef struct
+{
+    codeModel model;
+    uint32_t range; // size of the current range
+    uint32_t code; // position of the stream within the current range
+    bitReader* in; // the encoded stream, or NULL to read stdin
+    bool truncated; // true once the end of the stream has been read
+} entropyDecoder;
+
+
+/*******************************************************************************
+ ***************************** entropyEncoder Functions ************************
+ ******************************************************************************/
+
+// returns a malloc'd entropyEncoder that writes to stdout with putBits
+entropyEncoder* entropyEncoderNew();
+
+// frees the malloc'd entropyEncoder
+void entropyEncoderDelete(entropyEncoder* enc);
+
+// encodes code, which fits in nbits bits
+void entropyEncodeCode(entropyEncoder* enc, unsigned char nbits, unsigned int code);
+
+// encodes the character following an ESCAPE_CODE
+void entropyEncodeChar(entropyEncoder* enc, unsigned char c);
+
+/* writes out everything still held by enc. Must be called after the last code
+ * and before flushBits */
+void entropyEncoderFlush(entropyEncoder* enc);
+
+/* starts enc coding afresh after entropyEncoderFlush, keeping what its model
+ * has learned, so that other bits can be written between the two */
+void entropyEncoderRestart(entropyEncoder* enc);
+
+
+/*******************************************************************************
+ ***************************** entropyDecoder Functions ************************
+ ******************************************************************************/
+
+/* returns a malloc'd entropyDecoder reading from in, or from stdin with getBits
+ * if in is NULL */
+entropyDecoder* entropyDecoderNew(bitReader* in);
+
+// frees the malloc'd entropyDecoder
+void entropyDecoderDelete(entropyDecoder* dec);
+
+/* starts dec decoding afresh where the encoder called entropyEncoderRestart.
+ * Everything the encoder wrote before its entropyEncoderFlush must have been
+ * decoded; nothing more of it is read */
+void entropyDecoderRestart(entropyDecoder* dec);
+
+/* decodes a code that was encoded with a width of nbits. Returns EOF if the
+ * stream ended too early */
+int entropyDecodeCode(entropyDecoder* dec, unsigned char nbits);
+
+// decodes an escaped character. Returns EOF if the stream ended too early
+int entropyDecodeChar(entropyDecoder* dec);
+
+#endif
@@ -0,0 +1,330 @@
+/* 
+ * File:   filter.c
+ * Author: Alexander Schurman (alexander.schurman@yale.edu)
+ * 
+ * Created on October 18, 2026
+ * 
+ * Implementation of the filters described in filter.h. Where SSE2 is
+ * available, 16 bytes are filtered at a time; the scalar code handles
+ * everything else and gives the same results.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include "filter.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*******************************************************************************
+********************************* Misc. Functions ******************************
+*******************************************************************************/
+
+bool filterWidthValid(unsigned int filters, unsigned int width)
+{
+    return (filters & ~ALL_FILTERS) == 0 &&
+           (width == 1 || width == 2 || width == 4 || width == 8);
+}
+
+// subtracts the little-endian word at prev from the one at word
+void wordSub(unsigned char* word, const unsigned char* prev, unsigned int width)
+{
+    int borrow = 0;
+    
+    for(unsigned int i = 0; i < width; i++)
+    {
+        int diff = word[i] - prev[i] - borrow;
+        borrow = diff < 0;
+        word[i] = (unsigned char)diff;
+    }
+}
+
+// adds the little-endian word at prev to the one at word
+void wordAdd(unsigned char* word, const unsigned char* prev, unsigned int width)
+{
+    int carry = 0;
+    
+    for(unsigned int i = 0; i < width; i++)
+    {
+        int sum = word[i] + prev[i] + carry;
+        carry = sum > UINT8_MAX;
+        word[i] = (unsigned char)sum;
+    }
+}
+
+
+/*******************************************************************************
+******************************** Delta Coding **********************************
+*******************************************************************************/
+
+// replaces each of the numWords words at block, but the first, with its
+// difference from the word before
+void deltaEncode(unsigned char* block, size_t numWords, unsigned int width)
+{
+    size_t end = numWords * width; // the words before end are still to be done
+    
+#ifdef __SSE2__
+    // going from the end back, each word is subtracted from before it changes
+    while(end >= width + sizeof(__m128i))
+    {
+        end -= sizeof(__m128i);
+        
+        __m128i x = _mm_loadu_si128((__m128i*)&block[end]);
+        __m128i prev = _mm_loadu_si128((__m128i*)&block[end - width]);
+        switch(width)
+        {
+            case 1: x = _mm_sub_epi8(x, prev); break;
+            case 2: x = _mm_sub_epi16(x, prev); break;
+            case 4: x = _mm_sub_epi32(x, prev); break;
+            case 8: x = _mm_sub_epi64(x, prev); break;
+        }
+        _mm_storeu_si128((__m128i*)&block[end], x);
+    }
+#endif
+    
+    for(; end >= 2 * width; end -= width)
+    {
+        wordSub(&block[end - width], &block[end - 2 * width], width);
+    }
+}
+
+#ifdef __SSE2__
+/* returns the running sums of the words in x, each added to the word at prev,
+ * which is the decoded word just before x */
+__m128i prefixSum(__m128i x, const unsigned char* prev, unsigned int width)
+{
+    uint16_t prev16;
+    uint32_t prev32;
+    int64_t prev64;
+    
+    // the shifts need constant counts, so each width gets its own steps
+    switch(width)
+    {
+        case 1:
+            x = _mm_add_epi8(x, _mm_slli_si128(x, 1));
+            x = _mm_add_epi8(x, _mm_slli_si128(x, 2));
+            x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+            x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+            return _mm_add_epi8(x, _mm_set1_epi8(*prev));
+        
+        case 2:
+            memcpy(&prev16, prev, sizeof(prev16));
+            x = _mm_add_epi16(x, _mm_slli_si128(x, 2));
+            x = _mm_add_epi16(x, _mm_slli_si128(x, 4));
+            x = _mm_add_epi16(x, _mm_slli_si128(x, 8));
+            return _mm_add_epi16(x, _mm_set1_epi16(prev16));
+        
+        case 4:
+            memcpy(&prev32, prev, sizeof(prev32));
+            x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+            x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+            return _mm_add_epi32(x, _mm_set1_epi32(prev32));
+        
+        default:
+            memcpy(&prev64, prev, sizeof(prev64));
+            x = _mm_add_epi64(x, _mm_slli_si128(x, 8));
+            return _mm_add_epi64(x, _mm_set1_epi64x(prev64));
+    }
+}
+#endif
+
+// undoes deltaEncode by adding each word to the (decoded) word before it
+void deltaDecode(unsigned char* block, size_t numWords, unsigned int width)
+{
+    size_t end = numWords * width;
+    size_t i = width; // the first word is left as it is
+    
+#ifdef __SSE2__
+    for(; i + sizeof(__m128i) <= end; i += sizeof(__m128i))
+    {
+        __m128i x = _mm_loadu_si128((__m128i*)&block[i]);
+        x = prefixSum(x, &block[i - width], width);
+        _mm_storeu_si128((__m128i*)&block[i], x);
+    }
+#endif
+    
+    for(; i < end; i += width)
+    {
+        wordAdd(&block[i], &block[i - width], width);
+    }
+}
+
+
+/*******************************************************************************
+********************************* Shuffling ************************************
+*******************************************************************************/
+
+#ifdef __SSE2__
+/* shuffles the 16 words starting with word j of the numWords words at in into
+ * out. Each round splits the bytes of pairs of vectors into their even and
+ * odd bytes; after log2(width) rounds the vectors hold whole byte planes */
+void shuffleGroup(const unsigned char* in,
+                  unsigned char* out,
+                  size_t numWords,
+                  size_t j,
+                  unsigned int width)
+{
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    __m128i v[MAX_FILTER_WIDTH], next[MAX_FILTER_WIDTH];
+    unsigned int half = width / 2;
+    
+    for(unsigned int k = 0; k < width; k++)
+    {
+        v[k] = _mm_loadu_si128((__m128i*)&in[j * width + k * sizeof(__m128i)]);
+    }
+    
+    for(unsigned int round = 1; round < width; round *= 2)
+    {
+        for(unsigned int k = 0; k < half; k++)
+        {
+            __m128i a = v[2 * k], b = v[2 * k + 1];
+            next[k] = _mm_packus_epi16(_mm_and_si128(a, lowBytes),
+                                       _mm_and_si128(b, lowBytes));
+            next[k + half] = _mm_packus_epi16(_mm_srli_epi16(a, 8),
+                                              _mm_srli_epi16(b, 8));
+        }
+        memcpy(v, next, sizeof(__m128i) * width);
+    }
+    
+    for(unsigned int k = 0; k < width; k++)
+    {
+        _mm_storeu_si128((__m128i*)&out[k * numWords + j], v[k]);
+    }
+}
+
+// undoes shuffleGroup, interleaving the bytes of pairs of vectors each round
+void unshuffleGroup(const unsigned char* in,
+                    unsigned char* out,
+                    size_t numWords,
+                    size_t j,
+                    unsigned int width)
+{
+    __m128i v[MAX_FILTER_WIDTH], next[MAX_FILTER_WIDTH];
+    unsigned int half = width / 2;
+    
+    for(unsigned int k = 0; k < width; k++)
+    {
+        v[k] = _mm_loadu_si128((__m128i*)&in[k * numWords + j]);
+    }
+    
+    for(unsigned int round = 1; round < width; round *= 2)
+    {
+        for(unsigned int k = 0; k < half; k++)
+        {
+            next[2 * k] = _mm_unpacklo_epi8(v[k], v[k + half]);
+            next[2 * k + 1] = _mm_unpackhi_epi8(v[k], v[k + half]);
+        }
+        memcpy(v, next, sizeof(__m128i) * width);
+    }
+    
+    for(unsigned int k = 0; k < width; k++)
+    {
+        _mm_storeu_si128((__m128i*)&out[j * width + k * sizeof(__m128i)], v[k]);
+    }
+}
+#endif
+
+// writes byte k of each of the numWords words at in to out[k * numWords + j]
+void shuffle(const unsigned char* in,
+             unsigned char* out,
+             size_t numWords,
+             unsigned int width)
+{
+    size_t j = 0;
+    
+#ifdef __SSE2__
+    for(; j + sizeof(__m128i) <= numWords; j += sizeof(__m128i))
+    {
+        shuffleGroup(in, out, numWords, j, width);
+    }
+#endif
+    
+    for(; j < numWords; j++)
+    {
+        for(unsigned int k = 0; k < width; k++)
+        {
+            out[k * numWords + j] = in[j * width + k];
+        }
+    }
+}
+
+// undoes shuffle
+void unshuffle(const unsigned char* in,
+               unsigned char* out,
+               size_t numWords,
+               unsigned int width)
+{
+    size_t j = 0;
+    
+#ifdef __SSE2__
+    for(; j + sizeof(__m128i) <= numWords; j += sizeof(__m128i))
+    {
+        unshuffleGroup(in, out, numWords, j, width);
+    }
+#endif
+    
+    for(; j < numWords; j++)
+    {
+        for(unsigned int k = 0; k < width; k++)
+        {
+            out[j * width + k] = in[k * numWords + j];
+        }
+    }
+}
+
+
+/*******************************************************************************
+********************************** Filtering ***********************************
+*******************************************************************************/
+
+unsigned char* filterBlock(unsigned int filters,
+                           unsigned int width,
+                           unsigned char* block,
+                           unsigned char* scratch,
+                           size_t len)
+{
+    size_t numWords = len / width;
+    
+    if(filters & FILTER_DELTA)
+    {
+        deltaEncode(block, numWords, width);
+    }
+    
+    if(filters & FILTER_SHUFFLE)
+    {
+        shuffle(block, scratch, numWords, width);
+        memcpy(&scratch[numWords * width],
+               &block[numWords * width],
+               len - numWords * width);
+        block = scratch;
+    }
+    
+    return block;
+}
+
+unsigned char* unfilterBlock(unsigned int filters,
+                             unsigned int width,
+                             unsigned char* block,
+                             unsigned char* scratch,
+                             size_t len)
+{
+    size_t numWords = len / width;
+    
+    if(filters & FILTER_SHUFFLE)
+    {
+        unshuffle(block, scratch, numWords, width);
+        memcpy(&scratch[numWords * width],
+               &block[numWords * width],
+               len - numWords * width);
+        block = scratch;
+    }
+    
+    if(filters & FILTER_DELTA)
+    {
+        deltaDecode(block, numWords, width);
+    }
+    
+    return block;
+}
@@ -0,0 +1,52 @@
+/* 
+ * File:   filter.h
+ * Author: Alexander Schurman
+ * 
+ * Created on October 18, 2026
+ * 
+ * Interface for the reversible filters that encode can apply to each block of
+ * input before the LZW loop, and that decode undoes after it. The filters
+ * treat a block as an array of little-endian words of a fixed width, which
+ * lets LZW find repeats in arrays of integers and floats:
+ * delta coding replaces each word with its difference from the word before,
+ * and shuffling regroups the bytes of the words so that all of their first
+ * bytes come first, then all of their second bytes, and so on.
+ * Any bytes past the last whole word of a block are left as they are.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef FILTER_H
+#define FILTER_H
+
+// the filters, which can be combined; delta coding is applied first
+enum
+{
+    FILTER_DELTA = 1 << 0, // subtract the previous word from each word
+    FILTER_SHUFFLE = 1 << 1, // group the bytes of the words by position
+    ALL_FILTERS = FILTER_DELTA | FILTER_SHUFFLE
+};
+
+#define MAX_FILTER_WIDTH (8) // the widest word the filters handle
+
+// returns true if the filters can treat words of width bytes
+bool filterWidthValid(unsigned int filters, unsigned int width);
+
+/* applies filters with words of width bytes to the len bytes at block, using
+ * scratch, which must hold len bytes. Returns whichever of block and scratch
+ * holds the filtered bytes; block may be changed either way */
+unsigned char* filterBlock(unsigned int filters,
+                           unsigned int width,
+                           unsigned char* block,
+                           unsigned char* scratch,
+                           size_t len);
+
+/* undoes filterBlock for the len bytes at block, in the same way */
+unsigned char* unfilterBlock(unsigned int filters,
+                             unsigned int width,
+                             unsigned char* block,
+                             unsigned char* scratch,
+                             size_t len);
+
+#endif
@@ -8,18 +8,131 @@
  * algorithm
  */
 
+#define _POSIX_C_SOURCE 200809L // for fstat, posix_fallocate, and mmap
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "code.h"
 #include "lzw.h"
 #include "stringTable.h"
 #include "stack.h"
+#include "entropy.h"
+#include "filter.h"
+#include "tune.h"
+#include "crc.h"
+#include "mem.h"
+#include "compress.h"
+#include "trace.h"
 
 #define NBITS_MAXBITS (5) // the number of bits used to represent MAXBITS
 #define NBITS_WINDOW (24) // the number of bits used to represent WINDOW
 #define NBITS_EFLAG (1) // the number of bits used to represent -e
 
+/* Streams that use any of the header flags below start with an extended
+ * header: EXTENDED_HEADER in place of MAXBITS, the flags, then MAXBITS (with
+ * NBITS_EXT_MAXBITS bits), WINDOW and -e as above. Streams without flags keep
+ * the original header, so they can be read by any version of decode. */
+#define EXTENDED_HEADER (0) // never a valid MAXBITS
+#define NBITS_FLAGS (16) // the number of bits used to represent the flags
+#define NBITS_EXT_MAXBITS (6) // the number of bits used for extended MAXBITS
+
+// the header flags
+enum
+{
+    FLAG_ENTROPY = 1 << 0, // codes are entropy coded (-r)
+    FLAG_RESET = 1 << 1, // the encoder may send RESET_CODE (-c)
+    FLAG_POLICY = 1 << 2, // the pruning policy follows the header (-P)
+    FLAG_WIDE = 1 << 3, // MAXBITS or WINDOW is too big for the original header
+    FLAG_PRUNE_AHEAD = 1 << 4, // pruned tables are prepared in advance (-t)
+    FLAG_STORED = 1 << 5, // the encoder may send STORED_CODE (-s)
+    FLAG_FILTER = 1 << 6, // the input blocks were filtered (-d and -x)
+    FLAG_LENGTH = 1 << 7, // the length of the input follows the header
+    FLAG_CHECKSUM = 1 << 8, // each block is followed by its checksum (-k)
+    
+    // every flag this version of decode can read
+    KNOWN_FLAGS = FLAG_ENTROPY | FLAG_RESET | FLAG_POLICY | FLAG_WIDE |
+                  FLAG_PRUNE_AHEAD | FLAG_STORED | FLAG_FILTER | FLAG_LENGTH |
+                  FLAG_CHECKSUM
+};
+
+#define NBITS_POLICY (4) // the number of bits used to represent the policy
+#define NBITS_FILTERS (4) // the number of bits used to represent the filters
+#define NBITS_FILTER_WIDTH (4) // the number of bits used for the filter width
+
+// the input length is written in NUM_LENGTH_PARTS parts of NBITS_LENGTH_PART
+// bits, most significant first
+#define NBITS_LENGTH_PART (16)
+#define NUM_LENGTH_PARTS (4)
+
+// the largest MAXBITS and WINDOW the original header (and original decode)
+// can handle; larger ones set FLAG_WIDE, and WINDOW is then written as two
+// halves of NBITS_WIDE_WINDOW_HALF bits
+#define MAX_ORIGINAL_MAXBITS (24)
+#define MAX_ORIGINAL_WINDOW ((1UL << NBITS_WINDOW) - 1)
+#define NBITS_WIDE_WINDOW_HALF (16)
+
+// input is read, and filtered, in blocks of BLOCK_SIZE bytes. For -s, a block whose byte
+// histogram is within 1/STORED_SKEW_DIVISOR of flat (by the chi-squared
+// statistic) is taken to be incompressible and sent as it is, with its length
+// less one in NBITS_STORED_LENGTH bits
+#define BLOCK_SIZE (1 << 16)
+#define STORED_SKEW_DIVISOR (16)
+#define NBITS_STORED_LENGTH (16)
+
+// for -k, each block of input is followed by the code for the prefix it ends
+// with, CHECK_CODE, and the CRC-32C of the block (before filtering) as
+// CHECKSUM_BYTES chars, most significant first
+#define CHECKSUM_BYTES (4)
+
+// for -c, the compression ratio is measured over every RESET_INTERVAL bytes
+// of input, and once the table has filled it is reset when the ratio falls
+// below RESET_THRESHOLD percent of the best recent ratio. The best ratio loses
+// 1/RATIO_DECAY of itself each interval so that one very compressible stretch
+// doesn't cause resets forever after.
+#define RESET_INTERVAL (8192)
+#define RESET_THRESHOLD (80)
+#define RATIO_DECAY (64)
+#define RATIO_SCALE (1024) // fixed-point scale of the measured ratios
+
+// for -t, the pruned table is prepared from the codes in the table once all
+// but 1/PRUNE_AHEAD_FRACTION of the codes are in use. Codes added after that
+// are lost at the prune.
+#define PRUNE_AHEAD_FRACTION (16)
+
+// the match-extension fast path looks up the codes it has sent by a hash of
+// the first MATCH_HASH_BYTES of their strings, in a table of MATCH_HASH_SIZE
+#define MATCH_HASH_BYTES (4)
+#define MATCH_HASH_BITS (16)
+#define MATCH_HASH_SIZE (1 << MATCH_HASH_BITS)
+#define MATCH_HASH_MULTIPLIER (2654435761U) // Knuth's multiplicative hash
+
+// the run fast path jumps straight to the code for a run of a repeated byte
+// once the run is at least RUN_MIN_LENGTH bytes long. The codes for the runs
+// of each byte are kept in arrays of at least RUN_INIT_SIZE entries.
+#define RUN_MIN_LENGTH (16)
+#define RUN_INIT_SIZE (16)
+
+// with -f, each code sent may be for a string up to FLEX_SPAN - 1 bytes shorter
+// than the longest match, when that lengthens the match after it
+#define FLEX_SPAN (16)
+
+// the inner loops of encode and decode are written once, as inline functions
+// that take the features a stream uses as constant flags, and compiled into a
+// copy for each combination of them, chosen when the stream starts. Inlining
+// is forced so that every copy has the flags folded in.
+#ifdef __GNUC__
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+
 /*******************************************************************************
 ************************** Common to Encode and Decode *************************
  ******************************************************************************/
@@ -29,7 +142,7 @@ void outputStringTable(stringTable* table, char* filename)
 {
     FILE* output = fopen(filename, "w+");
     
-    for(unsigned int i = NUM_SPECIAL_CODES; i <= table->highestCode; i++)
+    for(unsigned int i = table->firstCode; i <= table->highestCode; i++)
     {
         tableElt* elt = &(table->array[i]);
         
@@ -43,272 +156,2657 @@ void outputStringTable(stringTable* table, char* filename)
     fclose(output);
 }
 
+/* returns the lowest code for a string in a stream with the given header flags;
+ * it is just past the last special code the stream may use */
+unsigned int firstCodeFor(unsigned int flags)
+{
+    if(flags & FLAG_CHECKSUM)
+    {
+        return CHECK_CODE + 1;
+    }
+    else if(flags & FLAG_STORED)
+    {
+        return STORED_CODE + 1;
+    }
+    else if(flags & FLAG_RESET)
+    {
+        return RESET_CODE + 1;
+    }
+    else
+    {
+        return NUM_ORIGINAL_SPECIAL_CODES;
+    }
+}
+
+/* returns the number of bits per code at the start of a stream with the given
+ * header flags, and after a reset */
+unsigned char initialNbits(bool eFlag, unsigned int flags)
+{
+    if(!eFlag)
+    {
+        return 9;
+    }
+    
+    // STORED_CODE and CHECK_CODE may be sent before any string has been added
+    return (flags & (FLAG_STORED | FLAG_CHECKSUM)) ? 3 : 2;
+}
+
+/* for -t, starts preparing the pruned table in *job once the table passes its
+ * high-water mark, unless one is already being prepared. lastCode is the
+ * highest code both encode and decode have added; pending is true if encode
+ * has added the code after it, which decode adds only on reading the next
+ * code. */
+void checkPruneAhead(stringTable* table,
+                     pruneInfo* pi,
+                     unsigned long window,
+                     pruneJob** job,
+                     unsigned int lastCode,
+                     bool pending)
+{
+    if(*job || !pruneInfoPrunes(pi, window) ||
+       lastCode + pending < table->arraySize -
+                            table->arraySize / PRUNE_AHEAD_FRACTION)
+    {
+        return;
+    }
+    
+    *job = pruneJobStart(table, pi, window, lastCode);
+}
+
+/* prunes table as stringTablePrune does, or, if *job is preparing a pruned
+ * table, swaps that in (leaving codeToUpdate alone) */
+stringTable* pruneTable(stringTable* table,
+                        pruneInfo* pi,
+                        unsigned long window,
+                        pruneJob** job,
+                        unsigned int* codeToUpdate)
+{
+    if(*job)
+    {
+        table = pruneJobFinish(*job, table, pi);
+        *job = NULL;
+        return table;
+    }
+    
+    return stringTablePrune(table, pi, window, codeToUpdate);
+}
+
+// throws away the pruned table *job is preparing, if any
+void cancelPruneAhead(pruneJob** job)
+{
+    if(*job)
+    {
+        pruneJobCancel(*job);
+        *job = NULL;
+    }
+}
+
 
 /*******************************************************************************
 ********************************** Encode **************************************
 *******************************************************************************/
 
-/* checks to see if the number of bits per code needs to be increased, and if so
- * sends the GROW_NBITS_CODE and increments nbits */
-void checkNbits(unsigned char* nbits, stringTable* table)
+/* what the encoder knows about a code for the match-extension fast path,
+ * which lets it skip the hash searches for bytes of input that repeat a string
+ * it has sent before */
+typedef struct
+{
+    unsigned long long start; // where in the input its string last started
+    unsigned int length; // the length of its string
+    unsigned int child; // the code last added with it as prefix, or
+                        // EMPTY_PREFIX
+} codeHint;
+
+typedef struct encoder encoder;
+
+/* encodes the len bytes at data, carrying the prefix *c; see encodeBytes */
+typedef void (*encodeKernel)(encoder* enc,
+                             unsigned int* c,
+                             const unsigned char* data,
+                             size_t len);
+
+/* everything needed to carry an encode from one code to the next */
+struct encoder
+{
+    stringTable* table;
+    pruneInfo* pi;
+    
+    unsigned int maxBits; // the -m arg
+    unsigned long window; // the -p arg, or 0 if there's no pruning
+    bool eFlag; // true if -e was passed
+    bool cFlag; // true if -c was passed
+    bool tFlag; // true if -t was passed
+    bool sFlag; // true if -s was passed
+    bool kFlag; // true if -k was passed
+    bool fFlag; // true if -f was passed
+    bool prunes; // true if the table is pruned when full
+    unsigned int flags; // the header flags
+    unsigned char nbits; // number of bits sent per code
+    
+    encodeKernel kernel; // the inner loop for the stream's features
+    
+    pruneJob* job; // the pruned table being prepared for -t, or NULL
+    
+    entropyEncoder* coder; // entropy codes the codes for -r; NULL otherwise
+    bool counting; // true if codes are only counted, not written (for -a)
+    unsigned long long totalBits; // bits written (or counted) after the header
+    
+    // the match-extension fast path
+    codeHint* hints; // malloc'd, indexed by code
+    unsigned int numHints; // the malloc'd size of hints
+    unsigned int* recent; // malloc'd; codes recently sent, indexed by a hash
+                          // of the first MATCH_HASH_BYTES of their strings,
+                          // or EMPTY_PREFIX
+    unsigned long long blockStart; // where in the input the block being
+                                   // encoded starts
+    unsigned long long matchStart; // where in the input the current prefix
+                                   // starts
+    
+    // the run fast path
+    unsigned int* runs[1 << CHAR_BIT]; // malloc'd; runs[k][n] is the code for
+                                       // n + 1 k's, or NULL
+    unsigned int runLengths[1 << CHAR_BIT]; // the longest run of each byte in
+                                            // the table
+    unsigned int runSizes[1 << CHAR_BIT]; // the malloc'd sizes of runs
+    
+    // compression ratio monitoring for -c
+    bool filled; // true if the table has filled since the last reset
+    unsigned long inCount; // bytes read in the current interval
+    unsigned long bitsOut; // bits written in the current interval
+    unsigned long bestRatio; // best recent ratio of an interval
+};
+
+// writes code with enc->nbits bits
+void encoderPutCode(encoder* enc, unsigned int code)
 {
-    if(table->highestCode > (1 << *nbits) - 1)
+    enc->bitsOut += enc->nbits;
+    enc->totalBits += enc->nbits;
+    
+    if(enc->counting)
+    {
+        return;
+    }
+    else if(enc->coder)
+    {
+        entropyEncodeCode(enc->coder, enc->nbits, code);
+    }
+    else
     {
-        putBits(*nbits, GROW_NBITS_CODE);
-        (*nbits)++;
+        putBits(enc->nbits, code);
     }
 }
 
-/* outputs the escape character followed by k and updates the string table and
- * nbits */
-void escapeChar(stringTable* table,
-                pruneInfo* pi,
-                unsigned char k,
-                unsigned char* nbits)
+// writes the character following an ESCAPE_CODE
+void encoderPutChar(encoder* enc, unsigned char k)
 {
-    putBits(*nbits, ESCAPE_CODE);
-    putBits(8, k);
+    enc->bitsOut += 8;
+    enc->totalBits += 8;
+    
+    if(enc->counting)
+    {
+        return;
+    }
+    else if(enc->coder)
+    {
+        entropyEncodeChar(enc->coder, k);
+    }
+    else
+    {
+        putBits(8, k);
+    }
+}
 
-    unsigned int newCode;
-    stringTableAdd(table, EMPTY_PREFIX, k, &newCode);
-    pruneInfoSawCode(pi, newCode);
+// makes sure enc->hints has an entry for code
+void fitHints(encoder* enc, unsigned int code)
+{
+    if(code < enc->numHints)
+    {
+        return;
+    }
+    
+    unsigned int oldNumHints = enc->numHints;
+    if(enc->numHints == 0)
+    {
+        enc->numHints = enc->table->allocSize;
+    }
+    while(enc->numHints <= code)
+    {
+        enc->numHints = (enc->numHints > enc->table->arraySize / 2) ?
+                        enc->table->arraySize : enc->numHints * 2;
+    }
     
-    checkNbits(nbits, table);
+    enc->hints = memRealloc(enc->hints,
+                            sizeof(codeHint) * (size_t)enc->numHints);
+    memset(&enc->hints[oldNumHints],
+           0,
+           sizeof(codeHint) * (size_t)(enc->numHints - oldNumHints));
 }
 
-/* checks to see if table should be pruned, and if so, prints the PRUNE_CODE,
- * calls stringTablePrune, updates nbits, and returns the new stringTable. If
- * no pruning occurs, the original stringTable* is returned. */
-stringTable* checkPrune(stringTable* table,
-                        pruneInfo* pi,
-                        unsigned long window,
-                        unsigned int* oldPrefix,
-                        unsigned char* nbits)
+/* records that code, just added to the table for prefix followed by k, is the
+ * code for a longer run of k's if prefix is the code for the longest so far */
+static inline void noteRun(encoder* enc,
+                           unsigned int prefix,
+                           unsigned char k,
+                           unsigned int code)
 {
-    if(window > 0 && stringTableIsFull(table))
+    unsigned int length = enc->runLengths[k];
+    if((length == 0) ? prefix != EMPTY_PREFIX
+                     : prefix != enc->runs[k][length - 1])
     {
-        putBits(*nbits, PRUNE_CODE);
-        
-        table = stringTablePrune(table, pi, window, oldPrefix);
-        *oldPrefix = EMPTY_PREFIX;
-        
-        // update *nbits
-        for(*nbits = 2; (1 << *nbits) -1 < table->highestCode; (*nbits)++);
+        return;
     }
     
-    return table;
+    if(length == enc->runSizes[k])
+    {
+        enc->runSizes[k] = (length == 0) ? RUN_INIT_SIZE : length * 2;
+        enc->runs[k] = memRealloc(enc->runs[k],
+                                  sizeof(unsigned int) * enc->runSizes[k]);
+    }
+    enc->runs[k][length] = code;
+    enc->runLengths[k]++;
 }
 
-void encode(unsigned int maxBits, unsigned int window, bool eFlag)
+/* forgets the codes in enc->recent and the children of codes, and works out
+ * the lengths of the strings in enc->table and the codes for runs afresh, as
+ * after its codes have been renumbered */
+void clearHints(encoder* enc)
 {
-    stringTable* table = stringTableNew(maxBits, eFlag);
-    pruneInfo* pi = pruneInfoNew(maxBits);
+    stringTable* table = enc->table;
+    fitHints(enc, table->highestCode);
+    memset(enc->runLengths, 0, sizeof(enc->runLengths));
     
-    // write maxBits, window, and eFlag to stdout
-    putBits(NBITS_MAXBITS, maxBits);
-    putBits(NBITS_WINDOW, window);
-    eFlag ? putBits(NBITS_EFLAG, 1) : putBits(NBITS_EFLAG, 0);
+    // the prefixes of codes come before them, even in a pruned table
+    for(unsigned int i = table->firstCode; i <= table->highestCode; i++)
+    {
+        unsigned int prefix = table->array[i].prefix;
+        enc->hints[i].length = (prefix == EMPTY_PREFIX) ?
+                               1 : enc->hints[prefix].length + 1;
+        enc->hints[i].child = EMPTY_PREFIX;
+        noteRun(enc, prefix, table->array[i].k, i);
+    }
     
-    // the string table is populated with (c, k) pairs; c is the code for the
-    // prefix of the entry, k is the char appended to the end of the prefix
-    unsigned int c = EMPTY_PREFIX;
-    int k;
+    memset(enc->recent, 0, sizeof(unsigned int) * MATCH_HASH_SIZE);
+}
+
+// returns the index in enc->recent for the string starting at bytes
+unsigned int matchHash(const unsigned char* bytes)
+{
+    uint32_t word;
+    memcpy(&word, bytes, sizeof(word));
     
-    unsigned char nbits = (eFlag) ? 2 : 9; // number of bits sent per code
+    return (word * MATCH_HASH_MULTIPLIER) >> (32 - MATCH_HASH_BITS);
+}
+
+/* records that code has been sent for the prefix starting at enc->matchStart,
+ * data being the current block */
+void noteSent(encoder* enc, unsigned int code, const unsigned char* data)
+{
+    fitHints(enc, code);
+    codeHint* hint = &enc->hints[code];
+    hint->start = enc->matchStart;
     
-    while((k = getchar()) != EOF)
+    if(hint->length >= MATCH_HASH_BYTES && hint->start >= enc->blockStart)
     {
-        tableElt* elt = stringTableHashSearch(table, c, k);
-        
-        if(elt)
-        {
-            c = elt->code;
-        }
-        else if(c == EMPTY_PREFIX)
+        enc->recent[matchHash(&data[hint->start - enc->blockStart])] = code;
+    }
+}
+
+// records that code has been added to the table for prefix followed by a char
+void noteAdded(encoder* enc, unsigned int prefix, unsigned int code)
+{
+    if(code == 0) // the table was full
+    {
+        return;
+    }
+    
+    fitHints(enc, code);
+    codeHint* hint = &enc->hints[code];
+    if(prefix == EMPTY_PREFIX)
+    {
+        hint->length = 1;
+    }
+    else
+    {
+        hint->start = enc->hints[prefix].start;
+        hint->length = enc->hints[prefix].length + 1;
+        enc->hints[prefix].child = code;
+    }
+    hint->child = EMPTY_PREFIX;
+    
+    noteRun(enc, prefix, enc->table->array[code].k, code);
+}
+
+// returns how many of the first max bytes at a and b are the same
+size_t matchLength(const unsigned char* a, const unsigned char* b, size_t max)
+{
+    size_t n = 0;
+    
+    // compare a word at a time up to the first difference
+    uint64_t x, y;
+    while(n + sizeof(uint64_t) <= max)
+    {
+        memcpy(&x, &a[n], sizeof(x));
+        memcpy(&y, &b[n], sizeof(y));
+        if(x != y)
         {
-            // we're escaping k, so leave the prefix empty
-            escapeChar(table, pi, k, &nbits);
-            
-            table = checkPrune(table, pi, window, &c, &nbits);
-        }
-        else
-        {   
-            putBits(nbits, c);
-            pruneInfoSawCode(pi, c);
-            
-            stringTableAdd(table, c, k, NULL);
-            
-            table = checkPrune(table, pi, window, &c, &nbits);
-            
-            checkNbits(&nbits, table);
-            
-            tableElt* kCode = stringTableHashSearch(table, EMPTY_PREFIX, k);
-            if(kCode)
-            {
-                c = kCode->code;
-            }
-            else
-            {
-                escapeChar(table, pi, k, &nbits);
-                c = EMPTY_PREFIX; // since we escaped k, we now have no prefix
-                checkPrune(table, pi, window, &c, &nbits);
-            }
+            break;
         }
+        n += sizeof(uint64_t);
     }
     
-    if(c != EMPTY_PREFIX) putBits(nbits, c);
+    while(n < max && a[n] == b[n])
+    {
+        n++;
+    }
     
-    putBits(nbits, STOP_CODE);
-    flushBits();
-    stringTableDelete(table);
-    pruneInfoDelete(pi);
+    return n;
 }
 
-
-/*******************************************************************************
-********************************** Decode **************************************
-*******************************************************************************/
-
-bool decode()
+// returns how many of the first max bytes at bytes are k
+size_t runLength(const unsigned char* bytes, unsigned char k, size_t max)
 {
-    // get the header info
-    unsigned int maxBits = getBits(NBITS_MAXBITS);
-    unsigned int window = getBits(NBITS_WINDOW);
-    char eFlag = getBits(NBITS_EFLAG);
+    size_t n = 0;
     
-    stringTable* table = stringTableNew(maxBits, eFlag);
-    pruneInfo* pi = pruneInfoNew(maxBits);
+    // compare a word at a time with k in every byte up to the first difference
+    uint64_t run = (uint64_t)k * 0x0101010101010101ULL;
+    uint64_t x;
+    while(n + sizeof(uint64_t) <= max)
+    {
+        memcpy(&x, &bytes[n], sizeof(x));
+        if(x != run)
+        {
+            break;
+        }
+        n += sizeof(uint64_t);
+    }
     
-    unsigned int oldCode = EMPTY_PREFIX; // the previous code read from stdin
-    unsigned int newCode; // the code just read from stdin
-    unsigned int code; // initially equal to newCode, but then set to its
-                       // prefixes to obtain the entire string of newCode
+    while(n < max && bytes[n] == k)
+    {
+        n++;
+    }
     
-    unsigned char finalK = 0, k; // characters in newCode
-    stack* kStack = stackNew(); // holds characters from newCode in order to
-                                // put them in the correct order by reversal
+    return n;
+}
+
+/* the match-extension fast path. *c has just been started from data[*i], of
+ * the len bytes of the current block. Looks up the code in enc->recent for
+ * the bytes there, and if the input agrees with the start of its string, jumps
+ * *c to the longest prefix of that string it agrees with; then follows the
+ * last child added to *c for as long as the input agrees, leaving *i at the
+ * last byte matched. The hash searches would reach the same code, as the
+ * prefixes of a code are in the table too. If data[*i] starts a run of a
+ * repeated byte of at least RUN_MIN_LENGTH bytes, *c jumps to the code for
+ * as much of the run as the table has instead. */
+void extendMatch(encoder* enc,
+                 unsigned int* c,
+                 const unsigned char* data,
+                 size_t* i,
+                 size_t len)
+{
+    // keep to the current -c interval, so that checkReset is called as usual
+    size_t end = len;
+    if(enc->cFlag && *i + RESET_INTERVAL - enc->inCount - 1 < end)
+    {
+        end = *i + RESET_INTERVAL - enc->inCount - 1;
+    }
     
-    unsigned char nbits = (eFlag) ? 2 : 9; // number of bits per code
+    size_t matched = 1; // the length of the string for *c
     
-    while((newCode = code = getBits(nbits)) != STOP_CODE)
+    unsigned char k = data[*i];
+    size_t run = (enc->runLengths[k] >= RUN_MIN_LENGTH &&
+                  *i + RUN_MIN_LENGTH <= end &&
+                  data[*i + RUN_MIN_LENGTH - 1] == k) ?
+                 runLength(&data[*i],
+                           k,
+                           (enc->runLengths[k] < end - *i) ?
+                           enc->runLengths[k] : end - *i) : 0;
+    if(run >= RUN_MIN_LENGTH)
+    {
+        *c = enc->runs[k][run - 1];
+        matched = run;
+    }
+    else if(*i + MATCH_HASH_BYTES <= end)
     {
-        switch(code)
+        unsigned int code = enc->recent[matchHash(&data[*i])];
+        codeHint* hint = &enc->hints[code];
+        
+        // the string must have last appeared in this block
+        if(code != EMPTY_PREFIX && hint->start >= enc->blockStart)
         {
-            case EOF:
-            {
-                // getting EOF before the STOP_CODE is an error
-                stringTableDelete(table);
-                stackDelete(kStack);
-                pruneInfoDelete(pi);
-                return false;
-                break;
-            }
-            
-            case GROW_NBITS_CODE:
-            {
-                nbits++;
-                if(nbits > maxBits)
-                {
-                    stringTableDelete(table);
-                    stackDelete(kStack);
-                    pruneInfoDelete(pi);
-                    return false;
-                }
-                break;
-            }
-            
-            case PRUNE_CODE:
-            {
-                if(window == 0)
-                {
-                    stringTableDelete(table);
-                    stackDelete(kStack);
-                    pruneInfoDelete(pi);
-                    return false;
-                }
-                else
-                {
-                    table = stringTablePrune(table, pi, window, &oldCode);
-                    
-                    oldCode = EMPTY_PREFIX;
-
-                    // update nbits
-                    for(nbits = 2;
-                        (1 << nbits) -1 < table->highestCode;
-                        nbits++);
-                }
-                break;
-            }
+            size_t max = (hint->length < end - *i) ? hint->length : end - *i;
+            size_t agreed = matchLength(&data[*i],
+                                        &data[hint->start - enc->blockStart],
+                                        max);
             
-            case ESCAPE_CODE:
+            if(agreed > 1)
             {
-                if(eFlag == 0)
-                {
-                    stringTableDelete(table);
-                    stackDelete(kStack);
-                    pruneInfoDelete(pi);
-                    return false;
-                }
-                
-                unsigned char escapedChar = getBits(8);
-                putchar(escapedChar);
-                
-                if(oldCode != EMPTY_PREFIX)
+                for(size_t n = hint->length; n > agreed; n--)
                 {
-                    stringTableAdd(table, oldCode, escapedChar, NULL);
+                    code = enc->table->array[code].prefix;
                 }
-                
-                unsigned int tempCode;
-                stringTableAdd(table, EMPTY_PREFIX, escapedChar, &tempCode);
-                pruneInfoSawCode(pi, tempCode);
-                
-                oldCode = EMPTY_PREFIX; // reset prefix to EMPTY
-                break;
+                *c = code;
+                matched = agreed;
             }
-            
-            default:
-            {
-                pruneInfoSawCode(pi, newCode);
-                
-                if(!stringTableCodeSearch(table, code))
-                {
-                    stackPush(kStack, finalK);
-                    code = oldCode;
-                }
+        }
+    }
+    
+    unsigned int child;
+    while(*i + matched < end &&
+          (child = enc->hints[*c].child) != EMPTY_PREFIX &&
+          enc->table->array[child].k == data[*i + matched])
+    {
+        *c = child;
+        matched++;
+    }
+    
+    *i += matched - 1;
+    if(enc->cFlag)
+    {
+        enc->inCount += matched - 1;
+    }
+}
 
-                // push string for code onto kStack until we get to the code
-                // with an empty prefix, which goes into finalK
-                tableElt* elt = stringTableCodeSearch(table, code);
-                while(elt && elt->prefix != EMPTY_PREFIX)
-                {
-                    stackPush(kStack, elt->k);
-                    code = elt->prefix;
-                    
-                    elt = stringTableCodeSearch(table, code);
-                }
-                finalK = elt->k;
+/* the run fast path for the start of a block: if the prefix *c carried over
+ * from the last block is the code for a run of the byte data starts with,
+ * jumps *c to the code for as much more of the run as the table has, of the
+ * len bytes at data. Returns the number of bytes it took in. */
+size_t continueRun(encoder* enc,
+                   unsigned int* c,
+                   const unsigned char* data,
+                   size_t len)
+{
+    unsigned char k = data[0];
+    unsigned int length = enc->hints[*c].length;
+    if(length == 0 || length > enc->runLengths[k] ||
+       enc->runs[k][length - 1] != *c)
+    {
+        return 0;
+    }
+    
+    // keep to the current -c interval, as extendMatch does
+    size_t max = enc->runLengths[k] - length;
+    if(max > len)
+    {
+        max = len;
+    }
+    if(enc->cFlag && RESET_INTERVAL - enc->inCount - 1 < max)
+    {
+        max = RESET_INTERVAL - enc->inCount - 1;
+    }
+    
+    size_t run = runLength(data, k, max);
+    if(run > 0)
+    {
+        *c = enc->runs[k][length - 1 + run];
+        if(enc->cFlag)
+        {
+            enc->inCount += run;
+        }
+    }
+    
+    return run;
+}
 
-                // print the characters in correct order now that they've been
-                // reversed by pushing them onto kStack
-                putchar(finalK);
-                while(stackPop(kStack, &k))
-                {
-                    putchar(k);
-                }
+/* checks to see if the number of bits per code needs to be increased, and if so
+ * sends the GROW_NBITS_CODE and increments nbits */
+void checkNbits(encoder* enc)
+{
+    if(enc->table->highestCode > (1 << enc->nbits) - 1)
+    {
+        encoderPutCode(enc, GROW_NBITS_CODE);
+        enc->nbits++;
+    }
+}
 
-                // add oldCode to the table, then update it to the current code
-                if(oldCode != EMPTY_PREFIX)
-                {
-                    stringTableAdd(table, oldCode, finalK, NULL);
-                }
-                oldCode = newCode;
-                break;
-            }
-        }
+/* outputs the escape character followed by k and updates the string table and
+ * nbits */
+void escapeChar(encoder* enc, unsigned char k)
+{
+    encoderPutCode(enc, ESCAPE_CODE);
+    encoderPutChar(enc, k);
+    
+    unsigned int newCode;
+    stringTableAdd(enc->table, EMPTY_PREFIX, k, &newCode);
+    pruneInfoSawCode(enc->pi, newCode);
+    noteAdded(enc, EMPTY_PREFIX, newCode);
+    
+    if(enc->tFlag)
+    {
+        checkPruneAhead(enc->table,
+                        enc->pi,
+                        enc->window,
+                        &enc->job,
+                        enc->table->highestCode,
+                        false);
     }
     
-    stringTableDelete(table);
-    stackDelete(kStack);
-    pruneInfoDelete(pi);
-    return true;
-}
\ No newline at end of file
+    checkNbits(enc);
+}
+
+/* checks to see if table should be pruned, and if so, prints the PRUNE_CODE,
+ * calls stringTablePrune, updates nbits, and replaces enc->table with the new
+ * stringTable. */
+void checkPrune(encoder* enc, unsigned int* oldPrefix)
+{
+    if(stringTableIsFull(enc->table))
+    {
+        enc->filled = true;
+    }
+    
+    if(pruneInfoPrunes(enc->pi, enc->window) && stringTableIsFull(enc->table))
+    {
+        encoderPutCode(enc, PRUNE_CODE);
+        
+        enc->table = pruneTable(enc->table,
+                                enc->pi,
+                                enc->window,
+                                &enc->job,
+                                oldPrefix);
+        *oldPrefix = EMPTY_PREFIX;
+        clearHints(enc);
+        
+        // update nbits
+        for(enc->nbits = 2;
+            (1 << enc->nbits) -1 < enc->table->highestCode;
+            enc->nbits++);
+    }
+}
+
+/* sends the code for *prefix, if there is one, without adding to the table, so
+ * that encoding can go on from an empty prefix */
+void flushPrefix(encoder* enc, unsigned int* prefix)
+{
+    if(*prefix == EMPTY_PREFIX)
+    {
+        return;
+    }
+    
+    encoderPutCode(enc, *prefix);
+    pruneInfoSawCode(enc->pi, *prefix);
+    
+    if(enc->tFlag)
+    {
+        // decode takes a code to be pending once it has read it
+        checkPruneAhead(enc->table,
+                        enc->pi,
+                        enc->window,
+                        &enc->job,
+                        enc->table->highestCode,
+                        true);
+    }
+    
+    *prefix = EMPTY_PREFIX;
+}
+
+/* counts another byte of input for -c. At the end of each interval, checks to
+ * see if the compression ratio has deteriorated enough that the table should
+ * be reset, and if so, sends prefix and the RESET_CODE and resets the table,
+ * pruneInfo, and nbits. */
+void checkReset(encoder* enc, unsigned int* prefix)
+{
+    if(!enc->cFlag || ++enc->inCount < RESET_INTERVAL)
+    {
+        return;
+    }
+    
+    unsigned long ratio = enc->inCount * CHAR_BIT * RATIO_SCALE /
+                          (enc->bitsOut + 1);
+    enc->inCount = 0;
+    enc->bitsOut = 0;
+    
+    bool deteriorated = ratio * 100 < enc->bestRatio * RESET_THRESHOLD;
+    
+    enc->bestRatio -= enc->bestRatio / RATIO_DECAY;
+    if(ratio > enc->bestRatio)
+    {
+        enc->bestRatio = ratio;
+    }
+    
+    // while the table is still filling, it's adapting on its own
+    if(!enc->filled || !deteriorated)
+    {
+        return;
+    }
+    
+    flushPrefix(enc, prefix);
+    encoderPutCode(enc, RESET_CODE);
+    
+    cancelPruneAhead(&enc->job);
+    stringTableReset(enc->table);
+    pruneInfoReset(enc->pi);
+    clearHints(enc);
+    enc->nbits = initialNbits(enc->eFlag, enc->flags);
+    
+    enc->filled = false;
+}
+
+/* for -s, returns true if the len bytes at block look incompressible: their
+ * byte histogram is nearly flat, as it is for random or compressed data */
+bool blockIsIncompressible(const unsigned char* block, size_t len)
+{
+    unsigned long counts[1 << CHAR_BIT] = {0};
+    for(size_t i = 0; i < len; i++)
+    {
+        counts[block[i]]++;
+    }
+    
+    unsigned long long sumSquares = 0;
+    for(unsigned int i = 0; i < (1 << CHAR_BIT); i++)
+    {
+        sumSquares += (unsigned long long)counts[i] * counts[i];
+    }
+    
+    // the chi-squared statistic of counts against a flat histogram
+    unsigned long long chiSquared = (sumSquares << CHAR_BIT) / len - len;
+    
+    return chiSquared < len / STORED_SKEW_DIVISOR;
+}
+
+/* sends the len bytes at block as a stored block, after the code for *prefix
+ * (leaving the prefix empty). The string table is left as it is */
+void storeBlock(encoder* enc,
+                unsigned int* prefix,
+                const unsigned char* block,
+                size_t len)
+{
+    flushPrefix(enc, prefix);
+    encoderPutCode(enc, STORED_CODE);
+    
+    enc->totalBits += NBITS_STORED_LENGTH + len * CHAR_BIT;
+    if(enc->counting)
+    {
+        return;
+    }
+    
+    // the range coder is stopped around the stored bytes so that they can be
+    // copied straight through
+    if(enc->coder) entropyEncoderFlush(enc->coder);
+    putBits(NBITS_STORED_LENGTH, len - 1);
+    putBytes(block, len);
+    if(enc->coder) entropyEncoderRestart(enc->coder);
+}
+
+/* for -k, sends the code for *prefix (leaving the prefix empty), then the
+ * CHECK_CODE and crc, the checksum of the block just encoded */
+void putChecksum(encoder* enc, unsigned int* prefix, uint32_t crc)
+{
+    flushPrefix(enc, prefix);
+    encoderPutCode(enc, CHECK_CODE);
+    
+    for(int i = CHECKSUM_BYTES - 1; i >= 0; i--)
+    {
+        encoderPutChar(enc, (unsigned char)(crc >> (i * CHAR_BIT)));
+    }
+}
+
+// returns the header flags for options
+unsigned int headerFlags(const encodeOptions* options)
+{
+    unsigned int flags = 0;
+    if(options->rFlag) flags |= FLAG_ENTROPY;
+    if(options->cFlag) flags |= FLAG_RESET;
+    if(options->policy != POLICY_LRU) flags |= FLAG_POLICY;
+    if(options->maxBits > MAX_ORIGINAL_MAXBITS ||
+       options->window > MAX_ORIGINAL_WINDOW) flags |= FLAG_WIDE;
+    if(options->tFlag) flags |= FLAG_PRUNE_AHEAD;
+    if(options->sFlag) flags |= FLAG_STORED;
+    if(options->filters) flags |= FLAG_FILTER;
+    if(options->length >= 0) flags |= FLAG_LENGTH;
+    if(options->kFlag) flags |= FLAG_CHECKSUM;
+    
+    return flags;
+}
+
+// writes the header for options to stdout
+void putHeader(const encodeOptions* options)
+{
+    unsigned int flags = headerFlags(options);
+    
+    if(flags)
+    {
+        putBits(NBITS_MAXBITS, EXTENDED_HEADER);
+        putBits(NBITS_FLAGS, flags);
+        putBits(NBITS_EXT_MAXBITS, options->maxBits);
+    }
+    else
+    {
+        putBits(NBITS_MAXBITS, options->maxBits);
+    }
+    
+    if(flags & FLAG_WIDE)
+    {
+        putBits(NBITS_WIDE_WINDOW_HALF,
+                options->window >> NBITS_WIDE_WINDOW_HALF);
+        putBits(NBITS_WIDE_WINDOW_HALF, options->window);
+    }
+    else
+    {
+        putBits(NBITS_WINDOW, options->window);
+    }
+    options->eFlag ? putBits(NBITS_EFLAG, 1) : putBits(NBITS_EFLAG, 0);
+    
+    if(flags & FLAG_POLICY)
+    {
+        putBits(NBITS_POLICY, options->policy);
+    }
+    
+    if(flags & FLAG_FILTER)
+    {
+        putBits(NBITS_FILTERS, options->filters);
+        putBits(NBITS_FILTER_WIDTH, options->filterWidth);
+    }
+    
+    if(flags & FLAG_LENGTH)
+    {
+        for(int i = NUM_LENGTH_PARTS - 1; i >= 0; i--)
+        {
+            putBits(NBITS_LENGTH_PART,
+                    (options->length >> (i * NBITS_LENGTH_PART)) &
+                    ((1 << NBITS_LENGTH_PART) - 1));
+        }
+    }
+}
+
+/* the inner loop of encode over the len bytes at data, carrying the prefix *c.
+ * The flags say which features the stream uses, so that each copy is compiled
+ * without the tests for the rest: escape for -e, prune if the table is pruned
+ * when full, reset for -c, and frozen if the table is full and, without
+ * pruning or resets, will never change again, so nothing is added to it and
+ * nbits is fixed. */
+static ALWAYS_INLINE void encodeBytes(encoder* enc,
+                                      unsigned int* c,
+                                      const unsigned char* data,
+                                      size_t len,
+                                      bool escape,
+                                      bool prune,
+                                      bool reset,
+                                      bool frozen)
+{
+    size_t i = (*c != EMPTY_PREFIX && len > 0) ? continueRun(enc, c, data, len)
+                                               : 0;
+    for(; i < len; i++)
+    {
+        unsigned char k = data[i];
+        
+        if(reset) checkReset(enc, c);
+        
+        tableElt* elt = stringTableHashSearch(enc->table, *c, k);
+        
+        if(elt)
+        {
+            if(*c == EMPTY_PREFIX)
+            {
+                enc->matchStart = enc->blockStart + i;
+            }
+            *c = elt->code;
+        }
+        else if(escape && *c == EMPTY_PREFIX)
+        {
+            // we're escaping k, so leave the prefix empty
+            escapeChar(enc, k);
+            
+            if(prune || reset) checkPrune(enc, c);
+        }
+        else
+        {   
+            encoderPutCode(enc, *c);
+            if(prune) pruneInfoSawCode(enc->pi, *c);
+            noteSent(enc, *c, data);
+            
+            if(!frozen)
+            {
+                unsigned int newCode;
+                stringTableAdd(enc->table, *c, k, &newCode);
+                noteAdded(enc, *c, newCode);
+                
+                if(prune && enc->tFlag)
+                {
+                    // decode adds (c, k) only on reading the next code
+                    checkPruneAhead(enc->table,
+                                    enc->pi,
+                                    enc->window,
+                                    &enc->job,
+                                    enc->table->highestCode - 1,
+                                    true);
+                }
+                
+                if(prune || reset) checkPrune(enc, c);
+                
+                checkNbits(enc);
+            }
+            
+            // without -e, the single-char strings are always the first codes
+            // in the table
+            tableElt* kCode = (escape) ? stringTableHashSearch(enc->table,
+                                                               EMPTY_PREFIX,
+                                                               k)
+                                       : &enc->table->array[
+                                             enc->table->firstCode + k];
+            if(kCode)
+            {
+                *c = kCode->code;
+                enc->matchStart = enc->blockStart + i;
+                extendMatch(enc, c, data, &i, len);
+            }
+            else
+            {
+                escapeChar(enc, k);
+                // since we escaped k, we now have no prefix
+                *c = EMPTY_PREFIX;
+                if(prune || reset) checkPrune(enc, c);
+            }
+        }
+    }
+}
+
+// defines a copy of encodeBytes named name with the given flags
+#define ENCODE_KERNEL(name, escape, prune, reset, frozen)                      \
+    void name(encoder* enc,                                                    \
+              unsigned int* c,                                                 \
+              const unsigned char* data,                                       \
+              size_t len)                                                      \
+    {                                                                          \
+        encodeBytes(enc, c, data, len, escape, prune, reset, frozen);          \
+    }
+
+ENCODE_KERNEL(encodePlain, false, false, false, false)
+ENCODE_KERNEL(encodeReset, false, false, true, false)
+ENCODE_KERNEL(encodePrune, false, true, false, false)
+ENCODE_KERNEL(encodePruneReset, false, true, true, false)
+ENCODE_KERNEL(encodeEscape, true, false, false, false)
+ENCODE_KERNEL(encodeEscapeReset, true, false, true, false)
+ENCODE_KERNEL(encodeEscapePrune, true, true, false, false)
+ENCODE_KERNEL(encodeEscapePruneReset, true, true, true, false)
+ENCODE_KERNEL(encodeFrozen, false, false, false, true)
+ENCODE_KERNEL(encodeEscapeFrozen, true, false, false, true)
+
+// the kernels for tables that can change, indexed by [escape][prune][reset]
+const encodeKernel encodeKernels[2][2][2] =
+{
+    {{encodePlain, encodeReset}, {encodePrune, encodePruneReset}},
+    {{encodeEscape, encodeEscapeReset},
+     {encodeEscapePrune, encodeEscapePruneReset}}
+};
+
+// the kernels for frozen tables, indexed by [escape]
+const encodeKernel frozenKernels[2] = {encodeFrozen, encodeEscapeFrozen};
+
+/* returns the length of the longest string in the table that the len bytes at
+ * data (len > 0) start with, recording the code for its first n bytes in
+ * codes[n % FLEX_SPAN] for each n. Without -e, there is always one of at least
+ * a byte. A run of the byte data starts with is taken in at once, as far as
+ * the table has codes for it. */
+size_t longestMatch(encoder* enc,
+                    const unsigned char* data,
+                    size_t len,
+                    unsigned int* codes)
+{
+    unsigned char k = data[0];
+    size_t n = runLength(data,
+                         k,
+                         (enc->runLengths[k] < len) ? enc->runLengths[k] : len);
+    for(size_t j = (n > FLEX_SPAN) ? n - FLEX_SPAN + 1 : 1; j <= n; j++)
+    {
+        codes[j % FLEX_SPAN] = enc->runs[k][j - 1];
+    }
+    
+    stringTable* table = enc->table;
+    unsigned int code = codes[n % FLEX_SPAN];
+    tableElt* elt;
+    while(n < len && (elt = stringTableHashSearch(table, code, data[n])))
+    {
+        code = elt->code;
+        n++;
+        codes[n % FLEX_SPAN] = code;
+    }
+    
+    return n;
+}
+
+/* the inner loop of encode -f over the len bytes at data, carrying the prefix
+ * *c, once the table is frozen. Rather than send the longest match at each
+ * point, it sends whichever of the match's last FLEX_SPAN prefixes reaches
+ * furthest into the input together with the longest match after it, keeping
+ * the longer on a tie. Since every prefix of a string in the table is in it
+ * too, this flexible parsing sends the fewest codes the frozen table allows,
+ * short of matches longer than FLEX_SPAN and the ends of blocks. The codes are
+ * ordinary ones, so decode reads them as it always has. */
+void encodeFlexible(encoder* enc,
+                    unsigned int* c,
+                    const unsigned char* data,
+                    size_t len)
+{
+    size_t i = 0;
+    
+    // a prefix carried from the last block is simply extended, as there's no
+    // going back into that block
+    if(*c != EMPTY_PREFIX)
+    {
+        tableElt* elt;
+        while(i < len && (elt = stringTableHashSearch(enc->table, *c, data[i])))
+        {
+            *c = elt->code;
+            i++;
+        }
+        
+        if(i < len)
+        {
+            encoderPutCode(enc, *c);
+        }
+    }
+    
+    if(i == len)
+    {
+        return;
+    }
+    
+    // the codes for the prefixes of the match at i, of the best match after
+    // it so far, and of the match being tried; see longestMatch
+    unsigned int buffers[3][FLEX_SPAN];
+    unsigned int* codes = buffers[0];
+    unsigned int* next = buffers[1];
+    unsigned int* tried = buffers[2];
+    unsigned int* swap;
+    
+    size_t match = longestMatch(enc, data + i, len - i, codes);
+    while(i + match < len)
+    {
+        size_t best = match;
+        size_t bestReach = match + longestMatch(enc,
+                                                data + i + match,
+                                                len - i - match,
+                                                next);
+        size_t shortest = (match > FLEX_SPAN) ? match - FLEX_SPAN + 1 : 1;
+        for(size_t n = match - 1; n >= shortest && bestReach < len - i; n--)
+        {
+            size_t reach = n + longestMatch(enc,
+                                            data + i + n,
+                                            len - i - n,
+                                            tried);
+            if(reach > bestReach)
+            {
+                best = n;
+                bestReach = reach;
+                swap = next;
+                next = tried;
+                tried = swap;
+            }
+        }
+        
+        encoderPutCode(enc, codes[best % FLEX_SPAN]);
+        
+        // the match after the one sent is already known
+        i += best;
+        match = bestReach - best;
+        swap = codes;
+        codes = next;
+        next = swap;
+    }
+    
+    // the last match may go on into the next block
+    *c = codes[match % FLEX_SPAN];
+}
+
+/* sets up enc to encode with options. If counting, nothing is written, and
+ * -r and -t are ignored */
+void encoderInit(encoder* enc, const encodeOptions* options, bool counting)
+{
+    enc->flags = headerFlags(options);
+    enc->table = stringTableNew(options->maxBits,
+                                firstCodeFor(enc->flags),
+                                options->eFlag);
+    enc->pi = pruneInfoNew(options->maxBits,
+                           pruneInfoPolicy(options->policy, options->window));
+    enc->maxBits = options->maxBits;
+    enc->window = options->window;
+    enc->eFlag = options->eFlag;
+    enc->cFlag = options->cFlag;
+    enc->tFlag = options->tFlag && !counting;
+    enc->sFlag = options->sFlag;
+    enc->kFlag = options->kFlag;
+    enc->fFlag = options->fFlag;
+    enc->prunes = pruneInfoPrunes(enc->pi, enc->window);
+    enc->nbits = initialNbits(enc->eFlag, enc->flags);
+    enc->kernel = encodeKernels[enc->eFlag][enc->prunes][enc->cFlag];
+    enc->job = NULL;
+    
+    enc->coder = (options->rFlag && !counting) ? entropyEncoderNew() : NULL;
+    enc->counting = counting;
+    enc->totalBits = 0;
+    
+    enc->hints = NULL;
+    enc->numHints = 0;
+    enc->recent = memAlloc(sizeof(unsigned int) * MATCH_HASH_SIZE);
+    enc->blockStart = 0;
+    enc->matchStart = 0;
+    memset(enc->runs, 0, sizeof(enc->runs));
+    memset(enc->runSizes, 0, sizeof(enc->runSizes));
+    clearHints(enc);
+    
+    enc->filled = false;
+    enc->inCount = 0;
+    enc->bitsOut = 0;
+    enc->bestRatio = 0;
+}
+
+/* encodes the len bytes of input at block, carrying the prefix *c from one
+ * block to the next (unless -k ends each block with a checksum). The block is
+ * filtered first, using scratch, so both may be changed */
+void encodeBlock(encoder* enc,
+                 const encodeOptions* options,
+                 unsigned int* c,
+                 unsigned char* block,
+                 unsigned char* scratch,
+                 size_t len)
+{
+    // the checksum is of the input as it was, so that it checks the filters
+    // are undone too; counting only needs its size
+    uint32_t crc = 0;
+    if(enc->kFlag && !enc->counting)
+    {
+        crc = crc32c(0, block, len);
+    }
+    
+    unsigned char* data = block;
+    if(options->filters)
+    {
+        data = filterBlock(options->filters,
+                           options->filterWidth,
+                           block,
+                           scratch,
+                           len);
+    }
+    
+    if(enc->sFlag && blockIsIncompressible(data, len))
+    {
+        storeBlock(enc, c, data, len);
+        enc->blockStart += len;
+        if(enc->kFlag) putChecksum(enc, c, crc);
+        return;
+    }
+    
+    // once a table that is never pruned or reset fills, it stays as it is
+    if(!enc->prunes && !enc->cFlag && stringTableIsFull(enc->table))
+    {
+        enc->kernel = (enc->fFlag) ? encodeFlexible : frozenKernels[enc->eFlag];
+    }
+    enc->kernel(enc, c, data, len);
+    
+    enc->blockStart += len;
+    if(enc->kFlag) putChecksum(enc, c, crc);
+}
+
+// sends the last prefix c and the STOP_CODE, and frees what enc holds
+void encoderFinish(encoder* enc, unsigned int c)
+{
+    if(c != EMPTY_PREFIX) encoderPutCode(enc, c);
+    
+    encoderPutCode(enc, STOP_CODE);
+    if(enc->coder)
+    {
+        entropyEncoderFlush(enc->coder);
+        entropyEncoderDelete(enc->coder);
+    }
+    if(!enc->counting) flushBits();
+    cancelPruneAhead(&enc->job);
+    stringTableDelete(enc->table);
+    pruneInfoDelete(enc->pi);
+    memFree(enc->hints);
+    memFree(enc->recent);
+    for(int k = 0; k < 1 << CHAR_BIT; k++)
+    {
+        memFree(enc->runs[k]);
+    }
+}
+
+/* reads the next block of input into block and returns its length (which is
+ * BLOCK_SIZE until the end of the input). The *aheadLen bytes at *ahead,
+ * which were read from stdin earlier, come first. */
+size_t readBlock(unsigned char* block,
+                 const unsigned char** ahead,
+                 size_t* aheadLen)
+{
+    size_t len = (*aheadLen < BLOCK_SIZE) ? *aheadLen : BLOCK_SIZE;
+    if(len)
+    {
+        memcpy(block, *ahead, len);
+        *ahead += len;
+        *aheadLen -= len;
+    }
+    
+    return len + fread(&block[len], 1, BLOCK_SIZE - len, stdin);
+}
+
+unsigned long long encodedBits(const encodeOptions* options,
+                               const unsigned char* in,
+                               size_t len)
+{
+    encoder enc;
+    encoderInit(&enc, options, true);
+    
+    unsigned int c = EMPTY_PREFIX;
+    
+    unsigned char block[BLOCK_SIZE];
+    unsigned char scratch[BLOCK_SIZE];
+    
+    for(size_t i = 0; i < len; i += BLOCK_SIZE)
+    {
+        size_t blockLen = (len - i < BLOCK_SIZE) ? len - i : BLOCK_SIZE;
+        memcpy(block, &in[i], blockLen);
+        encodeBlock(&enc, options, &c, block, scratch, blockLen);
+    }
+    
+    encoderFinish(&enc, c);
+    
+    return enc.totalBits;
+}
+
+long long inputLength()
+{
+    struct stat st;
+    off_t pos = ftello(stdin);
+    
+    if(pos < 0 || fstat(fileno(stdin), &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        return -1;
+    }
+    
+    return st.st_size - pos;
+}
+
+void encode(const encodeOptions* options)
+{
+    if(options->zFlag)
+    {
+        zEncode(options->maxBits);
+        return;
+    }
+    
+    // for -a, a sample of the input is read first to choose the options by
+    unsigned char* sample = NULL;
+    const unsigned char* ahead = NULL; // sampled input still to be encoded
+    size_t aheadLen = 0;
+    encodeOptions tuned;
+    
+    if(options->tune != TUNE_NONE)
+    {
+        sample = memAlloc(TUNE_SAMPLE_SIZE);
+        bool replay;
+        size_t sampleLen = readSample(sample, &replay);
+        
+        tuned = *options;
+        tuneOptions(&tuned, sample, sampleLen);
+        options = &tuned;
+        
+        if(replay)
+        {
+            ahead = sample;
+            aheadLen = sampleLen;
+        }
+    }
+    
+    encoder enc;
+    encoderInit(&enc, options, false);
+    
+    // write maxBits, window, eFlag, and any flags to stdout
+    putHeader(options);
+    
+    // the string table is populated with (c, k) pairs; c is the code for the
+    // prefix of the entry, k is the char appended to the end of the prefix
+    unsigned int c = EMPTY_PREFIX;
+    
+    unsigned char block[BLOCK_SIZE];
+    unsigned char scratch[BLOCK_SIZE]; // for filtering
+    
+    while(true)
+    {
+        unsigned long long begin = traceBegin();
+        size_t blockLen = readBlock(block, &ahead, &aheadLen);
+        traceEnd(TRACE_READ, begin);
+        if(blockLen == 0)
+        {
+            break;
+        }
+        
+        begin = traceBegin();
+        encodeBlock(&enc, options, &c, block, scratch, blockLen);
+        traceEnd(TRACE_CODE, begin);
+    }
+    
+    encoderFinish(&enc, c);
+    memFree(sample);
+}
+
+// returns the most bytes (as counted by mem.h) encoding with options can hold
+size_t encodeMaxMemory(const encodeOptions* options)
+{
+    size_t numCodes = (size_t)1 << options->maxBits;
+    prunePolicy policy = pruneInfoPolicy(options->policy, options->window);
+    
+    // compress's table is never pruned, and there are no hints
+    if(options->zFlag)
+    {
+        return stringTableMaxMemory(options->maxBits, POLICY_FREEZE, false);
+    }
+    
+    // hints grow with the table, by doubling, as do the codes for runs, which
+    // together hold no more than a code each
+    return stringTableMaxMemory(options->maxBits, policy, options->tFlag) +
+           sizeof(codeHint) * numCodes * 3 / 2 +
+           sizeof(unsigned int) * MATCH_HASH_SIZE +
+           sizeof(unsigned int) * (numCodes * 3 + RUN_INIT_SIZE *
+                                   (1 << CHAR_BIT));
+}
+
+bool encodeFitMemory(encodeOptions* options)
+{
+    // a table with room for a code for every byte of input never fills, so a
+    // larger one would encode it no differently
+    long long length = (options->length >= 0) ? options->length
+                                              : inputLength();
+    while(length >= 0 && options->maxBits > MIN_MAXBITS &&
+          (1ULL << (options->maxBits - 1)) >
+          (unsigned long long)length + NUM_SPECIAL_CODES + 256)
+    {
+        options->maxBits--;
+    }
+    
+    size_t available = memAvailable();
+    for(; options->maxBits >= MIN_MAXBITS; options->maxBits--)
+    {
+        if(encodeMaxMemory(options) <= available)
+        {
+            return true;
+        }
+        
+        // a larger table is worth more than having its prunes prepared ahead
+        if(options->tFlag)
+        {
+            options->tFlag = false;
+            if(encodeMaxMemory(options) <= available)
+            {
+                return true;
+            }
+            options->tFlag = true;
+        }
+    }
+    
+    return false;
+}
+
+
+/*******************************************************************************
+********************************** Decode **************************************
+*******************************************************************************/
+
+// the number of records decodeBatch decodes in lockstep
+#define DECODE_LANES (8)
+
+// the initial malloc'd size of a decoded record
+#define INIT_OUT_SIZE (256)
+
+// decode keeps the strings of codes it reads in a hot-string cache of
+// CACHE_SLOTS entries, indexed by code, whose strings are kept in an arena of
+// CACHE_ARENA_SIZE bytes that is overwritten from the start once it's full.
+// Strings shorter than CACHE_MIN_LENGTH are quicker to walk than to look up.
+#define CACHE_SLOTS (1 << 12)
+#define CACHE_ARENA_SIZE (1 << 20)
+#define CACHE_MIN_LENGTH (8)
+#define CACHE_MAX_LENGTH (4096)
+
+// decode unpacks up to CODE_BATCH codes at a time before expanding any of them
+#define CODE_BATCH (1024)
+
+// an entry in the hot-string cache
+typedef struct
+{
+    unsigned int code;
+    unsigned int generation; // the cache's generation when it was stored, or
+                             // 0 if the slot is empty
+    unsigned int length; // the length of the string
+    unsigned int uses; // the times it's been used, less the times another
+                       // string has been turned away from its slot
+    unsigned long long pos; // where the string starts, counting every byte
+                            // ever stored in the arena
+} cacheSlot;
+
+// the strings of recently read long codes, for copying out whole
+typedef struct
+{
+    cacheSlot* slots;
+    unsigned char* arena;
+    unsigned long long arenaPos; // the bytes ever stored in arena
+    unsigned int generation; // incremented when codes are renumbered, which
+                             // empties the cache
+    
+    unsigned long long hits; // the codes whose strings came from the cache
+} stringCache;
+
+// where a decoder is in its stream
+typedef enum
+{
+    DECODER_READING, // the next code is to be read
+    DECODER_EXPANDING, // the string for newCode is being pushed onto kStack
+    DECODER_DONE, // STOP_CODE has been read
+    DECODER_FAILED // the stream is invalid
+} DECODER_STATUS;
+
+/* everything needed to carry a decode from one code to the next, so that
+ * several independent streams can be decoded side by side */
+typedef struct
+{
+    stringTable* table;
+    pruneInfo* pi;
+    stack* kStack; // holds characters from newCode in order to put them in the
+                   // correct order by reversal
+    
+    unsigned int maxBits; // header info
+    unsigned int window;
+    bool eFlag;
+    bool tFlag;
+    unsigned int flags;
+    bool freezes; // true if the table stops changing once it's full, since
+                  // it is never pruned or reset
+    
+    pruneJob* job; // the pruned table being prepared for -t, or NULL
+    
+    unsigned int oldCode; // the previous code read
+    unsigned int newCode; // the code just read
+    unsigned int code; // initially equal to newCode, but then set to its
+                       // prefixes to obtain the entire string of newCode
+    unsigned char finalK; // the first character in newCode
+    unsigned char nbits; // number of bits per code
+    
+    bitReader* in; // the encoded stream, or NULL to read stdin
+    entropyDecoder* coder; // decodes entropy coded codes; NULL if there are none
+    int batch[CODE_BATCH]; // codes unpacked ahead of expanding them, ending
+                           // at the first special code or EOF, for decode
+    unsigned int batchPos; // the next code in batch to expand
+    unsigned int batchLen; // the number of codes in batch
+    unsigned int lastLen; // the length of the string of oldCode, if decode
+                          // wrote it in one piece to end at lastEnd, or 0
+    size_t lastEnd; // where in block or out it ended
+    unsigned char* out; // malloc'd decoded stream, or NULL to write stdout in
+                        // blocks
+    size_t outLen; // the number of bytes in out
+    size_t outSize; // the malloc'd size of out
+    bool outFixed; // true if out is a mapped file of outSize bytes, which
+                   // can't grow
+    bool overflowed; // true if more was decoded than a fixed out could hold
+    long long length; // the length of the decoded stream, if the header
+                      // gives it, or -1
+    
+    unsigned int filters; // the filters to undo (see filter.h), or 0
+    unsigned int filterWidth;
+    unsigned char* block; // the malloc'd block being decoded, for filters,
+                          // checksums, or verify; NULL to write bytes straight
+                          // out
+    unsigned char* scratch; // for filters, a malloc'd block for unfiltering
+    size_t blockLen; // the number of bytes in block
+    unsigned long long blockBegin; // when decoding the block began, for
+                                   // --timings, or 0
+    bool discard; // true if decoded blocks are thrown away (verify)
+    
+    uint32_t crc; // for -k, the checksum of the bytes written since the last
+                  // CHECK_CODE
+    size_t unchecked; // the number of those bytes
+    
+    stringCache* cache; // the hot-string cache, or NULL
+    unsigned long long codes; // the codes read, not counting special codes
+    unsigned long long bytes; // the bytes decoded
+    unsigned long long checks; // the checksums found correct
+    
+    DECODER_STATUS status;
+} decoder;
+
+// returns a malloc'd, empty stringCache
+stringCache* stringCacheNew()
+{
+    stringCache* cache = memAlloc(sizeof(stringCache));
+    cache->slots = memCalloc(CACHE_SLOTS, sizeof(cacheSlot));
+    cache->arena = memAlloc(CACHE_ARENA_SIZE);
+    cache->arenaPos = 0;
+    cache->generation = 1;
+    cache->hits = 0;
+    
+    return cache;
+}
+
+// frees the malloc'd cache
+void stringCacheDelete(stringCache* cache)
+{
+    memFree(cache->slots);
+    memFree(cache->arena);
+    memFree(cache);
+}
+
+/* returns the string for code from cache, putting its length in *len, or NULL
+ * if it isn't there */
+const unsigned char* stringCacheSearch(stringCache* cache,
+                                       unsigned int code,
+                                       unsigned int* len)
+{
+    cacheSlot* slot = &cache->slots[code % CACHE_SLOTS];
+    
+    // the string is gone if the arena has since been overwritten over it
+    if(slot->code != code ||
+       slot->generation != cache->generation ||
+       slot->pos + CACHE_ARENA_SIZE < cache->arenaPos)
+    {
+        return NULL;
+    }
+    
+    slot->uses++;
+    cache->hits++;
+    *len = slot->length;
+    return &cache->arena[slot->pos % CACHE_ARENA_SIZE];
+}
+
+/* makes room in cache for the len-byte string for code and returns where it
+ * should be written, or NULL if it shouldn't be cached. A slot whose string
+ * has been used is spared once for every use. */
+unsigned char* stringCacheAdd(stringCache* cache,
+                              unsigned int code,
+                              unsigned int len)
+{
+    if(len < CACHE_MIN_LENGTH || len > CACHE_MAX_LENGTH)
+    {
+        return NULL;
+    }
+    
+    cacheSlot* slot = &cache->slots[code % CACHE_SLOTS];
+    if(slot->generation == cache->generation &&
+       slot->pos + CACHE_ARENA_SIZE >= cache->arenaPos &&
+       slot->uses > 0)
+    {
+        slot->uses--;
+        return NULL;
+    }
+    
+    // strings don't wrap around the end of the arena
+    unsigned long long offset = cache->arenaPos % CACHE_ARENA_SIZE;
+    if(offset + len > CACHE_ARENA_SIZE)
+    {
+        cache->arenaPos += CACHE_ARENA_SIZE - offset;
+    }
+    
+    slot->code = code;
+    slot->generation = cache->generation;
+    slot->length = len;
+    slot->uses = 0;
+    slot->pos = cache->arenaPos;
+    cache->arenaPos += len;
+    
+    return &cache->arena[slot->pos % CACHE_ARENA_SIZE];
+}
+
+// empties cache, as when the codes are renumbered
+void stringCacheClear(stringCache* cache)
+{
+    cache->generation++;
+}
+
+// returns the next nBits bits from dec's stream, or EOF
+int decoderGetBits(decoder* dec, int nBits)
+{
+    return (dec->in) ? readBits(dec->in, nBits) : getBits(nBits);
+}
+
+// returns the next code from dec's stream, or EOF
+int decoderGetCode(decoder* dec)
+{
+    if(dec->coder)
+    {
+        return entropyDecodeCode(dec->coder, dec->nbits);
+    }
+    else
+    {
+        return decoderGetBits(dec, dec->nbits);
+    }
+}
+
+/* unpacks the next codes from dec's stream into dec->batch, stopping after
+ * the first special code (or EOF), since it can change nbits or be followed by
+ * something other than codes, or after CODE_BATCH codes */
+void decoderGetCodes(decoder* dec)
+{
+    unsigned long long begin = traceBegin();
+    int firstCode = dec->table->firstCode;
+    size_t count;
+    if(dec->coder)
+    {
+        // entropy coded codes can only be decoded one at a time
+        count = 0;
+        int code;
+        do
+        {
+            code = entropyDecodeCode(dec->coder, dec->nbits);
+            dec->batch[count++] = code;
+        } while(count < CODE_BATCH && code >= firstCode);
+    }
+    else if(dec->in)
+    {
+        count = readCodes(dec->in, dec->nbits, firstCode, dec->batch,
+                          CODE_BATCH);
+    }
+    else
+    {
+        count = getCodes(dec->nbits, firstCode, dec->batch, CODE_BATCH);
+    }
+    
+    dec->batchPos = 0;
+    dec->batchLen = count;
+    
+    traceEnd(TRACE_UNPACK, begin);
+}
+
+// returns the character following an ESCAPE_CODE, or EOF
+int decoderGetChar(decoder* dec)
+{
+    if(dec->coder)
+    {
+        return entropyDecodeChar(dec->coder);
+    }
+    else
+    {
+        return decoderGetBits(dec, 8);
+    }
+}
+
+// returns up to len bytes from dec's stream, at a byte boundary, in buf
+size_t decoderGetBytes(decoder* dec, unsigned char* buf, size_t len)
+{
+    return (dec->in) ? readBytes(dec->in, buf, len) : getBytes(buf, len);
+}
+
+/* makes room for len more bytes at the end of dec->out, growing it if it can.
+ * Returns false if there isn't room, and notes that out has overflowed. */
+bool decoderFitOut(decoder* dec, size_t len)
+{
+    if(dec->outLen + len <= dec->outSize)
+    {
+        return true;
+    }
+    else if(dec->outFixed)
+    {
+        dec->overflowed = true;
+        return false;
+    }
+    
+    while(dec->outLen + len > dec->outSize)
+    {
+        dec->outSize *= 2;
+    }
+    dec->out = realloc(dec->out, dec->outSize);
+    
+    return true;
+}
+
+// writes the len bytes at buf to dec's decoded stream
+void decoderWrite(decoder* dec, const unsigned char* buf, size_t len)
+{
+    dec->bytes += len;
+    
+    if(dec->discard)
+    {
+        return;
+    }
+    else if(!dec->out)
+    {
+        unsigned long long begin = traceBegin();
+        fwrite(buf, 1, len, stdout);
+        traceEnd(TRACE_WRITE, begin);
+        return;
+    }
+    
+    if(decoderFitOut(dec, len))
+    {
+        memcpy(&dec->out[dec->outLen], buf, len);
+        dec->outLen += len;
+    }
+}
+
+/* undoes the filters on the block decoded so far, adds it to the checksum if
+ * there is one, and writes it out */
+void decoderFlushBlock(decoder* dec)
+{
+    traceEnd(TRACE_CODE, dec->blockBegin);
+    
+    unsigned char* data = dec->block;
+    if(dec->filters)
+    {
+        data = unfilterBlock(dec->filters,
+                             dec->filterWidth,
+                             dec->block,
+                             dec->scratch,
+                             dec->blockLen);
+    }
+    
+    if(dec->flags & FLAG_CHECKSUM)
+    {
+        dec->crc = crc32c(dec->crc, data, dec->blockLen);
+        dec->unchecked += dec->blockLen;
+    }
+    
+    decoderWrite(dec, data, dec->blockLen);
+    dec->blockLen = 0;
+    dec->blockBegin = traceBegin();
+}
+
+// writes the len bytes at buf to dec's decoded stream
+void decoderPutBytes(decoder* dec, const unsigned char* buf, size_t len)
+{
+    if(!dec->block)
+    {
+        decoderWrite(dec, buf, len);
+        return;
+    }
+    
+    while(len > 0)
+    {
+        size_t n = (len < BLOCK_SIZE - dec->blockLen) ?
+                   len : BLOCK_SIZE - dec->blockLen;
+        memcpy(&dec->block[dec->blockLen], buf, n);
+        dec->blockLen += n;
+        buf += n;
+        len -= n;
+        
+        if(dec->blockLen == BLOCK_SIZE) decoderFlushBlock(dec);
+    }
+}
+
+// writes c to dec's decoded stream
+void decoderPutChar(decoder* dec, unsigned char c)
+{
+    if(dec->block)
+    {
+        dec->block[dec->blockLen++] = c;
+        if(dec->blockLen == BLOCK_SIZE) decoderFlushBlock(dec);
+        return;
+    }
+    
+    dec->bytes++;
+    if(decoderFitOut(dec, 1))
+    {
+        dec->out[dec->outLen++] = c;
+    }
+}
+
+/* copies the len bytes of a stored block from dec's stream to its decoded
+ * stream. Returns false if the stream ends first */
+bool decoderCopyBytes(decoder* dec, size_t len)
+{
+    unsigned char* dest;
+    
+    // encode stores whole input blocks, so a stored block fills the block
+    // being decoded, and otherwise goes to the end of out
+    if(dec->block)
+    {
+        dest = &dec->block[dec->blockLen];
+        if(len > BLOCK_SIZE - dec->blockLen)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        if(!decoderFitOut(dec, len))
+        {
+            return false;
+        }
+        dest = &dec->out[dec->outLen];
+    }
+    
+    size_t copied = decoderGetBytes(dec, dest, len);
+    if(dec->block)
+    {
+        dec->blockLen += copied;
+        if(dec->blockLen == BLOCK_SIZE) decoderFlushBlock(dec);
+    }
+    else
+    {
+        dec->outLen += copied;
+        dec->bytes += copied;
+    }
+    
+    return copied == len;
+}
+
+/* reads the header from in (or stdin if in is NULL) and sets up dec to decode
+ * the rest of the stream. Only stdin gets a hot-string cache, since the
+ * streams given to decodeBatch are small. Returns false if the header is
+ * invalid, in which case nothing needs to be freed. */
+bool decoderInit(decoder* dec, bitReader* in)
+{
+    dec->in = in;
+    
+    // get the header info
+    int flags = 0;
+    int maxBits = decoderGetBits(dec, NBITS_MAXBITS);
+    if(maxBits == EXTENDED_HEADER)
+    {
+        flags = decoderGetBits(dec, NBITS_FLAGS);
+        maxBits = decoderGetBits(dec, NBITS_EXT_MAXBITS);
+    }
+    long long window;
+    if(flags != EOF && (flags & FLAG_WIDE))
+    {
+        int high = decoderGetBits(dec, NBITS_WIDE_WINDOW_HALF);
+        int low = decoderGetBits(dec, NBITS_WIDE_WINDOW_HALF);
+        window = (high == EOF || low == EOF) ? EOF :
+                 (long long)high << NBITS_WIDE_WINDOW_HALF | low;
+    }
+    else
+    {
+        window = decoderGetBits(dec, NBITS_WINDOW);
+    }
+    int eFlag = decoderGetBits(dec, NBITS_EFLAG);
+    int policy = POLICY_LRU;
+    if(flags != EOF && (flags & FLAG_POLICY))
+    {
+        policy = decoderGetBits(dec, NBITS_POLICY);
+    }
+    int filters = 0, filterWidth = 1;
+    if(flags != EOF && (flags & FLAG_FILTER))
+    {
+        filters = decoderGetBits(dec, NBITS_FILTERS);
+        filterWidth = decoderGetBits(dec, NBITS_FILTER_WIDTH);
+    }
+    long long length = -1;
+    int lengthPart = 0;
+    if(flags != EOF && (flags & FLAG_LENGTH))
+    {
+        length = 0;
+        for(int i = 0; i < NUM_LENGTH_PARTS && lengthPart != EOF; i++)
+        {
+            lengthPart = decoderGetBits(dec, NBITS_LENGTH_PART);
+            length = length << NBITS_LENGTH_PART | lengthPart;
+        }
+    }
+    if(flags == EOF || maxBits == EOF || window == EOF || eFlag == EOF ||
+       policy == EOF || policy >= NUM_POLICIES ||
+       filters == EOF || filterWidth == EOF || lengthPart == EOF ||
+       !filterWidthValid(filters, filterWidth) ||
+       (flags & ~KNOWN_FLAGS) != 0 ||
+       maxBits < MIN_MAXBITS || maxBits > MAX_MAXBITS)
+    {
+        return false;
+    }
+    
+    dec->maxBits = maxBits;
+    dec->window = window;
+    dec->eFlag = eFlag;
+    dec->tFlag = (flags & FLAG_PRUNE_AHEAD) != 0;
+    dec->flags = flags;
+    dec->job = NULL;
+    
+    dec->table = stringTableNew(dec->maxBits,
+                                firstCodeFor(flags),
+                                dec->eFlag);
+    dec->pi = pruneInfoNew(dec->maxBits, pruneInfoPolicy(policy, dec->window));
+    dec->freezes = !pruneInfoPrunes(dec->pi, dec->window) &&
+                   !(flags & FLAG_RESET);
+    dec->kStack = stackNew();
+    dec->coder = (flags & FLAG_ENTROPY) ? entropyDecoderNew(in) : NULL;
+    dec->batchPos = 0;
+    dec->batchLen = 0;
+    dec->lastLen = 0;
+    dec->lastEnd = 0;
+    
+    dec->oldCode = EMPTY_PREFIX;
+    dec->finalK = 0;
+    dec->nbits = initialNbits(dec->eFlag, dec->flags);
+    
+    if(in)
+    {
+        dec->outSize = INIT_OUT_SIZE;
+        dec->out = malloc(dec->outSize);
+    }
+    else
+    {
+        dec->outSize = 0;
+        dec->out = NULL;
+    }
+    dec->outLen = 0;
+    dec->outFixed = false;
+    dec->overflowed = false;
+    dec->length = length;
+    
+    dec->filters = filters;
+    dec->filterWidth = filterWidth;
+    // the blocks of a stream with checksums are gathered up to be checked
+    dec->block = (filters || (flags & FLAG_CHECKSUM)) ? memAlloc(BLOCK_SIZE)
+                                                        : NULL;
+    dec->scratch = (filters) ? memAlloc(BLOCK_SIZE) : NULL;
+    dec->blockLen = 0;
+    dec->blockBegin = 0;
+    dec->discard = false;
+    
+    dec->crc = 0;
+    dec->unchecked = 0;
+    
+    dec->cache = (in) ? NULL : stringCacheNew();
+    dec->codes = 0;
+    dec->bytes = 0;
+    dec->checks = 0;
+    
+    dec->status = DECODER_READING;
+    return true;
+}
+
+// frees everything dec malloc'd except for its decoded stream
+void decoderDelete(decoder* dec)
+{
+    cancelPruneAhead(&dec->job);
+    stringTableDelete(dec->table);
+    stackDelete(dec->kStack);
+    pruneInfoDelete(dec->pi);
+    if(dec->coder) entropyDecoderDelete(dec->coder);
+    memFree(dec->block);
+    memFree(dec->scratch);
+    if(dec->cache) stringCacheDelete(dec->cache);
+}
+
+/* adds oldCode to the table now that the first character of newCode (finalK)
+ * is known, and moves on to the next code */
+void decoderEndCode(decoder* dec)
+{
+    // add oldCode to the table, then update it to the current code
+    if(dec->oldCode != EMPTY_PREFIX)
+    {
+        stringTableAdd(dec->table, dec->oldCode, dec->finalK, NULL);
+    }
+    dec->oldCode = dec->newCode;
+    dec->status = DECODER_READING;
+    
+    if(dec->tFlag)
+    {
+        // encode has already added (newCode, k) for the k after it
+        checkPruneAhead(dec->table,
+                        dec->pi,
+                        dec->window,
+                        &dec->job,
+                        dec->table->highestCode,
+                        true);
+    }
+}
+
+/* sets up dec to walk the string of newCode, which is not a special code.
+ * Leaves dec DECODER_EXPANDING, or DECODER_FAILED if newCode is invalid. If
+ * the string is in the hot-string cache, it is output straight away instead,
+ * and dec is left DECODER_READING */
+void decoderStartCode(decoder* dec, unsigned int newCode)
+{
+    dec->newCode = dec->code = newCode;
+    dec->codes++;
+    
+    const unsigned char* cached;
+    unsigned int len;
+    if(dec->cache && (cached = stringCacheSearch(dec->cache, newCode, &len)))
+    {
+        pruneInfoSawCode(dec->pi, dec->newCode);
+        decoderPutBytes(dec, cached, len);
+        dec->finalK = cached[0];
+        decoderEndCode(dec);
+        return;
+    }
+    
+    if(!stringTableCodeSearch(dec->table, dec->code))
+    {
+        // the only code not yet in the table that encode can send is the one
+        // about to be added for oldCode
+        if(dec->oldCode == EMPTY_PREFIX ||
+           stringTableIsFull(dec->table) ||
+           dec->code != dec->table->highestCode + 1)
+        {
+            dec->status = DECODER_FAILED;
+            return;
+        }
+        
+        stackPush(dec->kStack, dec->finalK);
+        dec->code = dec->oldCode;
+    }
+    
+    pruneInfoSawCode(dec->pi, dec->newCode);
+    dec->status = DECODER_EXPANDING;
+}
+
+/* handles newCode, a special code (or EOF) just read from dec's stream */
+void decoderSpecial(decoder* dec, int newCode)
+{
+    switch(newCode)
+    {
+        case EOF:
+        {
+            // getting EOF before the STOP_CODE is an error
+            dec->status = DECODER_FAILED;
+            break;
+        }
+        
+        case STOP_CODE:
+        {
+            if(dec->block) decoderFlushBlock(dec);
+            
+            // a decoded stream kept in out can be checked against the length
+            // in the header, and every byte of a stream with checksums must
+            // have been checked
+            if(dec->overflowed || dec->unchecked > 0 ||
+               (dec->out && dec->length >= 0 && dec->outLen != dec->length))
+            {
+                dec->status = DECODER_FAILED;
+                break;
+            }
+            
+            dec->status = DECODER_DONE;
+            break;
+        }
+        
+        case GROW_NBITS_CODE:
+        {
+            dec->nbits++;
+            if(dec->nbits > dec->maxBits)
+            {
+                dec->status = DECODER_FAILED;
+            }
+            break;
+        }
+        
+        case PRUNE_CODE:
+        {
+            if(!pruneInfoPrunes(dec->pi, dec->window))
+            {
+                dec->status = DECODER_FAILED;
+                break;
+            }
+            
+            dec->table = pruneTable(dec->table,
+                                    dec->pi,
+                                    dec->window,
+                                    &dec->job,
+                                    &dec->oldCode);
+            if(dec->cache) stringCacheClear(dec->cache);
+            
+            dec->oldCode = EMPTY_PREFIX;
+            
+            // update nbits
+            for(dec->nbits = 2;
+                (1 << dec->nbits) -1 < dec->table->highestCode;
+                dec->nbits++);
+            break;
+        }
+        
+        case ESCAPE_CODE:
+        {
+            int escapedChar;
+            if(dec->eFlag == 0 || (escapedChar = decoderGetChar(dec)) == EOF)
+            {
+                dec->status = DECODER_FAILED;
+                break;
+            }
+            
+            decoderPutChar(dec, escapedChar);
+            
+            if(dec->oldCode != EMPTY_PREFIX)
+            {
+                stringTableAdd(dec->table, dec->oldCode, escapedChar, NULL);
+            }
+            
+            unsigned int tempCode;
+            stringTableAdd(dec->table, EMPTY_PREFIX, escapedChar, &tempCode);
+            pruneInfoSawCode(dec->pi, tempCode);
+            
+            dec->oldCode = EMPTY_PREFIX; // reset prefix to EMPTY
+            
+            if(dec->tFlag)
+            {
+                checkPruneAhead(dec->table,
+                                dec->pi,
+                                dec->window,
+                                &dec->job,
+                                dec->table->highestCode,
+                                false);
+            }
+            break;
+        }
+        
+        case RESET_CODE:
+        {
+            if(!(dec->flags & FLAG_RESET))
+            {
+                dec->status = DECODER_FAILED;
+                break;
+            }
+            
+            cancelPruneAhead(&dec->job);
+            stringTableReset(dec->table);
+            pruneInfoReset(dec->pi);
+            if(dec->cache) stringCacheClear(dec->cache);
+            dec->nbits = initialNbits(dec->eFlag, dec->flags);
+            
+            dec->oldCode = EMPTY_PREFIX;
+            break;
+        }
+        
+        case STORED_CODE:
+        {
+            if(!(dec->flags & FLAG_STORED))
+            {
+                dec->status = DECODER_FAILED;
+                break;
+            }
+            
+            // the code before a stored block is sent without an addition to
+            // the table
+            dec->oldCode = EMPTY_PREFIX;
+            
+            int len = decoderGetBits(dec, NBITS_STORED_LENGTH);
+            if(len == EOF || !decoderCopyBytes(dec, (size_t)len + 1))
+            {
+                dec->status = DECODER_FAILED;
+                break;
+            }
+            
+            if(dec->coder) entropyDecoderRestart(dec->coder);
+            break;
+        }
+        
+        case CHECK_CODE:
+        {
+            if(!(dec->flags & FLAG_CHECKSUM))
+            {
+                dec->status = DECODER_FAILED;
+                break;
+            }
+            
+            // as with a stored block, the code before a checksum is sent
+            // without an addition to the table
+            dec->oldCode = EMPTY_PREFIX;
+            
+            uint32_t crc = 0;
+            int byte = 0;
+            for(int i = 0; i < CHECKSUM_BYTES && byte != EOF; i++)
+            {
+                byte = decoderGetChar(dec);
+                crc = crc << CHAR_BIT | (unsigned char)byte;
+            }
+            
+            // a full block has already been flushed
+            if(dec->blockLen > 0) decoderFlushBlock(dec);
+            
+            if(byte == EOF || crc != dec->crc)
+            {
+                dec->status = DECODER_FAILED;
+                break;
+            }
+            
+            dec->crc = 0;
+            dec->unchecked = 0;
+            dec->checks++;
+            break;
+        }
+        
+        default:
+        {
+            // a special code this stream doesn't use
+            dec->status = DECODER_FAILED;
+            break;
+        }
+    }
+}
+
+/* reads the next code from dec's stream. Special codes are handled entirely;
+ * for any other code, dec is left DECODER_EXPANDING with the string of the
+ * code to be walked by decoderExpand */
+void decoderRead(decoder* dec)
+{
+    int newCode = decoderGetCode(dec);
+    
+    if(newCode != EOF && newCode >= dec->table->firstCode)
+    {
+        decoderStartCode(dec, newCode);
+        return;
+    }
+    
+    decoderSpecial(dec, newCode);
+}
+
+/* outputs the string for newCode once it has been walked, keeping a copy in
+ * the hot-string cache if it's long enough, and adds oldCode to the table */
+void decoderFinishCode(decoder* dec)
+{
+    unsigned char k;
+    unsigned char* copy = (dec->cache) ?
+                          stringCacheAdd(dec->cache,
+                                         dec->newCode,
+                                         dec->kStack->dataLen + 1) : NULL;
+    
+    // print the characters in correct order now that they've been reversed by
+    // pushing them onto kStack
+    decoderPutChar(dec, dec->finalK);
+    if(copy) *copy++ = dec->finalK;
+    while(stackPop(dec->kStack, &k))
+    {
+        decoderPutChar(dec, k);
+        if(copy) *copy++ = k;
+    }
+    
+    decoderEndCode(dec);
+}
+
+/* takes one step along the prefixes of newCode, pushing its character onto
+ * kStack until we get to the code with an empty prefix, which goes into finalK
+ * and finishes the code */
+void decoderExpand(decoder* dec)
+{
+    tableElt* elt = stringTableCodeSearch(dec->table, dec->code);
+    
+    if(elt->prefix != EMPTY_PREFIX)
+    {
+        stackPush(dec->kStack, elt->k);
+        dec->code = elt->prefix;
+    }
+    else
+    {
+        dec->finalK = elt->k;
+        decoderFinishCode(dec);
+    }
+}
+
+/* returns where the next len bytes of dec's decoded stream can be written
+ * straight into place, or NULL if they have to go through decoderPutChar: if
+ * they'd fill the block being decoded, which then has to be flushed, or
+ * wouldn't fit in out */
+static inline unsigned char* decoderReserve(decoder* dec, size_t len)
+{
+    if(dec->block)
+    {
+        return (dec->blockLen + len < BLOCK_SIZE) ?
+               &dec->block[dec->blockLen] : NULL;
+    }
+    
+    return (dec->outLen + len <= dec->outSize) ? &dec->out[dec->outLen] : NULL;
+}
+
+// returns where the next byte of dec's decoded stream goes in block or out
+static inline size_t decoderOutPos(const decoder* dec)
+{
+    return (dec->block) ? dec->blockLen : dec->outLen;
+}
+
+// notes that len bytes have been written where decoderReserve said
+static inline void decoderCommit(decoder* dec, size_t len)
+{
+    if(dec->block)
+    {
+        dec->blockLen += len;
+    }
+    else
+    {
+        dec->outLen += len;
+        dec->bytes += len;
+    }
+}
+
+/* the inner loop of decode: reads codes from dec's stream and outputs their
+ * strings until it reads a special code, which is handled before returning,
+ * since it may change the table, or until the table freezes. It does the work of decoderRead and
+ * decoderExpand for a whole code at a time. The flags say which features the
+ * stream uses, so that each copy is compiled without the tests for the rest:
+ * frozen if the table is full and, without pruning or resets, will never
+ * change again, so nothing is added to it; cached if dec has a hot-string
+ * cache. The codes are unpacked a batch at a time by decoderGetCodes, so that
+ * neither loop waits on the other. */
+static ALWAYS_INLINE void decodeCodes(decoder* dec, bool frozen, bool cached)
+{
+    stringTable* table = dec->table;
+    stack* kStack = dec->kStack;
+    
+    while(dec->status == DECODER_READING)
+    {
+        // codes are unpacked a batch at a time, then expanded one by one
+        if(dec->batchPos == dec->batchLen)
+        {
+            decoderGetCodes(dec);
+        }
+        
+        int newCode = dec->batch[dec->batchPos++];
+        if(newCode == EOF || newCode < table->firstCode)
+        {
+            decoderSpecial(dec, newCode);
+            return;
+        }
+        
+        dec->newCode = newCode;
+        dec->codes++;
+        if(!frozen) pruneInfoSawCode(dec->pi, newCode);
+        
+        const unsigned char* cachedString;
+        unsigned int len;
+        if(cached &&
+           (cachedString = stringCacheSearch(dec->cache, newCode, &len)))
+        {
+            decoderPutBytes(dec, cachedString, len);
+            dec->finalK = cachedString[0];
+            dec->lastLen = 0;
+        }
+        else
+        {
+            unsigned int code = newCode;
+            unsigned char* dest = NULL;
+            if(code > table->highestCode)
+            {
+                // the only code not yet in the table that encode can send is
+                // the one about to be added for oldCode
+                if(frozen || dec->oldCode == EMPTY_PREFIX ||
+                   stringTableIsFull(table) ||
+                   code != table->highestCode + 1)
+                {
+                    dec->status = DECODER_FAILED;
+                    return;
+                }
+                
+                // its string is oldCode's followed by its first character, so
+                // if oldCode's was just written, it's copied from there rather
+                // than walked. The codes for a run of one byte come this way.
+                len = dec->lastLen + 1;
+                if(dec->lastLen > 0 && decoderOutPos(dec) == dec->lastEnd)
+                {
+                    dest = decoderReserve(dec, len);
+                }
+                
+                if(!dest)
+                {
+                    stackPush(kStack, dec->finalK);
+                    code = dec->oldCode;
+                }
+            }
+            
+            if(dest)
+            {
+                memcpy(dest, dest - (len - 1), len - 1);
+                dest[len - 1] = dec->finalK;
+            }
+            else
+            {
+                // walk the prefixes of code, pushing the string's characters
+                // from the last back to the second
+                const tableElt* array = table->array;
+                while(array[code].prefix != EMPTY_PREFIX)
+                {
+                    stackPush(kStack, array[code].k);
+                    code = array[code].prefix;
+                }
+                dec->finalK = array[code].k;
+                
+                len = kStack->dataLen + 1;
+                dest = decoderReserve(dec, len);
+                if(dest)
+                {
+                    dest[0] = dec->finalK;
+                    for(unsigned int i = 1; i < len; i++)
+                    {
+                        dest[i] = kStack->data[len - 1 - i];
+                    }
+                }
+            }
+            
+            unsigned char* copy = (cached) ? stringCacheAdd(dec->cache,
+                                                            newCode,
+                                                            len) : NULL;
+            
+            if(dest)
+            {
+                decoderCommit(dec, len);
+                dec->lastLen = len;
+                dec->lastEnd = decoderOutPos(dec);
+                
+                if(copy) memcpy(copy, dest, len);
+            }
+            else
+            {
+                dec->lastLen = 0;
+                decoderPutChar(dec, dec->finalK);
+                if(copy) copy[0] = dec->finalK;
+                for(unsigned int i = 1; i < len; i++)
+                {
+                    decoderPutChar(dec, kStack->data[len - 1 - i]);
+                    if(copy) copy[i] = kStack->data[len - 1 - i];
+                }
+            }
+            kStack->dataLen = 0;
+        }
+        
+        if(frozen)
+        {
+            dec->oldCode = newCode;
+        }
+        else
+        {
+            decoderEndCode(dec);
+            
+            if(dec->freezes && stringTableIsFull(table))
+            {
+                return;
+            }
+        }
+    }
+}
+
+// decodes the codes from dec's stream up to the next special code
+typedef void (*decodeKernel)(decoder* dec);
+
+// defines a copy of decodeCodes named name with the given flags
+#define DECODE_KERNEL(name, frozen, cached)                                    \
+    void name(decoder* dec)                                                    \
+    {                                                                          \
+        decodeCodes(dec, frozen, cached);                                      \
+    }
+
+DECODE_KERNEL(decodeGrowing, false, false)
+DECODE_KERNEL(decodeGrowingCached, false, true)
+DECODE_KERNEL(decodeFrozen, true, false)
+DECODE_KERNEL(decodeFrozenCached, true, true)
+
+// the decode kernels, indexed by [frozen][cached]
+const decodeKernel decodeKernels[2][2] =
+{
+    {decodeGrowing, decodeGrowingCached},
+    {decodeFrozen, decodeFrozenCached}
+};
+
+/* decodes the rest of dec's stream, filling in stats unless it is NULL, and
+ * frees dec. Returns true if successful. */
+bool decoderRun(decoder* dec, decodeStats* stats)
+{
+    // whole blocks are quicker to write than single chars
+    if(!dec->out && !dec->block)
+    {
+        dec->block = memAlloc(BLOCK_SIZE);
+    }
+    
+    dec->blockBegin = traceBegin();
+    while(dec->status == DECODER_READING)
+    {
+        bool frozen = dec->freezes && stringTableIsFull(dec->table);
+        decodeKernels[frozen][dec->cache != NULL](dec);
+    }
+    
+    // a stream decoded straight into out is timed as a single block
+    if(!dec->block) traceEnd(TRACE_CODE, dec->blockBegin);
+    
+    if(stats)
+    {
+        stats->codes = dec->codes;
+        stats->cacheHits = (dec->cache) ? dec->cache->hits : 0;
+        stats->bytes = dec->bytes;
+        stats->checks = dec->checks;
+    }
+    
+    decoderDelete(dec);
+    return dec->status == DECODER_DONE;
+}
+
+// returns the most bytes (as counted by mem.h) decoding dec's stream can hold
+size_t decoderMaxMemory(const decoder* dec)
+{
+    size_t numCodes = (size_t)1 << dec->maxBits;
+    size_t held = stringTableMaxMemory(dec->maxBits,
+                                       dec->pi->policy,
+                                       dec->tFlag);
+    
+    // kStack can come to hold the longest string, doubling as it grows
+    held += sizeof(stack) + numCodes * 3 + 2 * BLOCK_SIZE;
+    if(dec->cache)
+    {
+        held += sizeof(stringCache) + sizeof(cacheSlot) * CACHE_SLOTS +
+                CACHE_ARENA_SIZE;
+    }
+    
+    return held;
+}
+
+/* sets up dec to decode stdin, going without the hot-string cache if that's
+ * what it takes to stay within the memory limit. Returns false if the stream
+ * is invalid or would need more memory than the limit allows, setting
+ * stats->overLimit in the latter case (unless stats is NULL) */
+bool startDecode(decoder* dec, decodeStats* stats)
+{
+    if(stats) stats->overLimit = false;
+    if(!decoderInit(dec, NULL))
+    {
+        return false;
+    }
+    
+    size_t available = memAvailable();
+    if(decoderMaxMemory(dec) > available)
+    {
+        stringCacheDelete(dec->cache);
+        dec->cache = NULL;
+        
+        if(decoderMaxMemory(dec) > available)
+        {
+            if(stats) stats->overLimit = true;
+            decoderDelete(dec);
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+bool decode(decodeStats* stats)
+{
+    if(zDetect())
+    {
+        return zDecode(stats, false);
+    }
+    
+    decoder dec;
+    if(!startDecode(&dec, stats))
+    {
+        return false;
+    }
+    
+    return decoderRun(&dec, stats);
+}
+
+bool verify(decodeStats* stats)
+{
+    if(zDetect())
+    {
+        return zDecode(stats, true);
+    }
+    
+    decoder dec;
+    if(!startDecode(&dec, stats))
+    {
+        return false;
+    }
+    
+    dec.discard = true;
+    
+    return decoderRun(&dec, stats);
+}
+
+/* creates the file at path with length bytes and maps it into memory. Returns
+ * the mapping, or NULL if any of that fails */
+unsigned char* mapOutput(const char* path, size_t length)
+{
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if(fd < 0)
+    {
+        return NULL;
+    }
+    
+    // allocate the blocks up front, so that the file is laid out in one piece
+    // and running out of space is found now rather than as a fault mid-write
+    void* map = MAP_FAILED;
+    if(posix_fallocate(fd, 0, length) == 0)
+    {
+        map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    
+    return (map == MAP_FAILED) ? NULL : map;
+}
+
+bool decodeToFile(const char* path, decodeStats* stats)
+{
+    if(zDetect())
+    {
+        return freopen(path, "wb", stdout) && zDecode(stats, false);
+    }
+    
+    decoder dec;
+    if(!startDecode(&dec, stats))
+    {
+        return false;
+    }
+    
+    unsigned char* map = NULL;
+    // the pages of a mapped file count towards resident memory, so there's no
+    // mapping under a memory limit
+    if(dec.length > 0 && dec.length <= SIZE_MAX && memLimit() == 0)
+    {
+        map = mapOutput(path, dec.length);
+    }
+    
+    if(!map)
+    {
+        if(!freopen(path, "wb", stdout))
+        {
+            decoderDelete(&dec);
+            return false;
+        }
+        
+        return decoderRun(&dec, stats);
+    }
+    
+    dec.out = map;
+    dec.outSize = dec.length;
+    dec.outFixed = true;
+    
+    bool ok = decoderRun(&dec, stats);
+    munmap(map, dec.length);
+    
+    return ok;
+}
+
+/* starts decoding records from *nextRecord onwards in lane, skipping any
+ * records whose header is invalid. Returns the record being decoded, or NULL
+ * if there are no records left. */
+lzwRecord* startRecord(decoder* lane,
+                       bitReader* in,
+                       lzwRecord* records,
+                       size_t numRecords,
+                       size_t* nextRecord)
+{
+    while(*nextRecord < numRecords)
+    {
+        lzwRecord* record = &records[(*nextRecord)++];
+        
+        initBits(in, record->in, record->inLen);
+        if(decoderInit(lane, in))
+        {
+            return record;
+        }
+        
+        record->out = NULL;
+        record->outLen = 0;
+        record->ok = false;
+    }
+    
+    return NULL;
+}
+
+// stores the result of lane's decode in record and frees the lane
+void finishRecord(decoder* lane, lzwRecord* record)
+{
+    record->ok = (lane->status == DECODER_DONE);
+    
+    if(record->ok)
+    {
+        record->out = lane->out;
+        record->outLen = lane->outLen;
+    }
+    else
+    {
+        free(lane->out);
+        record->out = NULL;
+        record->outLen = 0;
+    }
+    
+    decoderDelete(lane);
+}
+
+bool decodeBatch(lzwRecord* records, size_t numRecords)
+{
+    decoder lanes[DECODE_LANES];
+    bitReader ins[DECODE_LANES];
+    lzwRecord* laneRecords[DECODE_LANES]; // NULL if a lane is idle
+    
+    size_t nextRecord = 0;
+    unsigned int numActive = 0;
+    
+    for(unsigned int i = 0; i < DECODE_LANES; i++)
+    {
+        laneRecords[i] = startRecord(&lanes[i],
+                                     &ins[i],
+                                     records,
+                                     numRecords,
+                                     &nextRecord);
+        if(laneRecords[i]) numActive++;
+    }
+    
+    while(numActive > 0)
+    {
+        // read one code in every lane
+        for(unsigned int i = 0; i < DECODE_LANES; i++)
+        {
+            if(laneRecords[i] && lanes[i].status == DECODER_READING)
+            {
+                decoderRead(&lanes[i]);
+            }
+        }
+        
+        // walk the strings of those codes one prefix at a time in every lane,
+        // so the independent table lookups can be in flight together
+        bool expanding = true;
+        while(expanding)
+        {
+            expanding = false;
+            for(unsigned int i = 0; i < DECODE_LANES; i++)
+            {
+                if(laneRecords[i] && lanes[i].status == DECODER_EXPANDING)
+                {
+                    decoderExpand(&lanes[i]);
+                    expanding |= (lanes[i].status == DECODER_EXPANDING);
+                }
+            }
+        }
+        
+        // refill the lanes whose records are finished
+        for(unsigned int i = 0; i < DECODE_LANES; i++)
+        {
+            if(laneRecords[i] && (lanes[i].status == DECODER_DONE ||
+                                  lanes[i].status == DECODER_FAILED))
+            {
+                finishRecord(&lanes[i], laneRecords[i]);
+                laneRecords[i] = startRecord(&lanes[i],
+                                             &ins[i],
+                                             records,
+                                             numRecords,
+                                             &nextRecord);
+                if(!laneRecords[i]) numActive--;
+            }
+        }
+    }
+    
+    bool allOk = true;
+    for(size_t i = 0; i < numRecords; i++)
+    {
+        allOk &= records[i].ok;
+    }
+    
+    return allOk;
+}
@@ -9,19 +9,124 @@
  */
 
 #include <stdbool.h>
+#include <stddef.h>
+#include "stringTable.h"
 
 #ifndef LZW_H
 #define LZW_H
 
-/* encodes stdin into stdout.
- * maxBits is the maximum number of bits allowed per code. It must be in the
- *     range [8, 24]
- * window is the window size for pruning. If zero, no pruning will happen.
- * eFlag indicates if encode was passed the -e argument. */
-void encode(unsigned int maxBits, unsigned int window, bool eFlag);
+// the range of values allowed for maxBits
+#define MIN_MAXBITS (9)
+#define MAX_MAXBITS (30)
 
-/* decodes stdin into stdout. Returns true if successful, false if stdin is an
- * invalid encoded stream */
-bool decode();
+// the objectives -a can choose maxBits, window, and eFlag for
+typedef enum
+{
+    TUNE_NONE, // -a wasn't passed; the options are used as they are
+    TUNE_SPEED, // the fastest encode that compresses nearly as well as the best
+    TUNE_SIZE, // the smallest output
+    TUNE_BALANCED // the smallest product of output size and encoding time
+} tuneObjective;
+
+// the options passed to encode
+typedef struct
+{
+    unsigned int maxBits; // the maximum number of bits allowed per code. It
+                          // must be in the range [MIN_MAXBITS, MAX_MAXBITS]
+    unsigned int window; // the window size for pruning. If zero, no pruning
+                         // will happen.
+    bool eFlag; // indicates if encode was passed the -e argument
+    bool rFlag; // indicates if encode was passed the -r argument, to entropy
+                // code the codes
+    bool cFlag; // indicates if encode was passed the -c argument, to reset
+                // the table when the compression ratio deteriorates
+    prunePolicy policy; // how the table is pruned when full (the -P arg)
+    bool tFlag; // indicates if encode was passed the -t argument, to prepare
+                // pruned tables on another thread
+    bool sFlag; // indicates if encode was passed the -s argument, to send
+                // incompressible blocks as they are
+    unsigned int filters; // the filters from filter.h to apply to each block
+                          // of input (-d and -x), or 0
+    unsigned int filterWidth; // the width of the words the filters treat
+    tuneObjective tune; // for -a, what to choose maxBits, window, and eFlag
+                        // for by encoding a sample of stdin first
+    long long length; // the length of stdin, to record in the header so that
+                      // decode can preallocate its output, or -1
+    bool kFlag; // indicates if encode was passed the -k argument, to follow
+                // each block of input with its checksum
+    bool zFlag; // indicates if encode was passed the -Z argument, to write the
+                // format of compress (see compress.h) instead; maxBits must
+                // then be in the range [Z_MIN_BITS, Z_MAX_BITS] and the other
+                // options are unused
+    bool fFlag; // indicates if encode was passed the -f argument, to choose
+                // each code by looking ahead at the match after it instead
+                // of taking the longest once the table is full; the table
+                // must then never be pruned or reset, and -e is not allowed
+} encodeOptions;
+
+/* returns the number of bytes left in stdin if it is a regular file, or -1 if
+ * that can't be known in advance */
+long long inputLength();
+
+/* encodes stdin into stdout with the given options */
+void encode(const encodeOptions* options);
+
+/* for --max-memory, lowers options->maxBits, and drops -t, as far as needed
+ * for encode to stay within the limit set with memSetLimit (see mem.h). A
+ * maxBits larger than the input can fill is lowered regardless. Returns false
+ * if no maxBits is small enough. */
+bool encodeFitMemory(encodeOptions* options);
+
+/* returns the number of bits encode would write after the header for the len
+ * bytes at in with the given options, without writing anything. -r and -t are
+ * ignored. Can be called from several threads at once. */
+unsigned long long encodedBits(const encodeOptions* options,
+                               const unsigned char* in,
+                               size_t len);
+
+// what decode reports about its work (decode -v)
+typedef struct
+{
+    unsigned long long codes; // the codes read, not counting special codes
+    unsigned long long cacheHits; // the codes whose strings were copied from
+                                  // the hot-string cache rather than walked
+    unsigned long long bytes; // the bytes decoded
+    unsigned long long checks; // the block checksums (-k) found correct
+    bool overLimit; // true if the stream would need more memory than the
+                    // limit set with memSetLimit allows, so wasn't decoded
+} decodeStats;
+
+/* decodes stdin into stdout, filling in stats unless it is NULL. Returns true
+ * if successful, false if stdin is an invalid encoded stream. Streams in the
+ * format of compress (see compress.h) are decoded as well, as are they by
+ * verify and decodeToFile. */
+bool decode(decodeStats* stats);
+
+/* decodes stdin as decode does, checking the checksums of streams written
+ * with -k, but throws the decoded stream away instead of writing it */
+bool verify(decodeStats* stats);
+
+/* decodes stdin into the file at path as decode does, except that if the
+ * header gives the length of the decoded stream, the file is preallocated and
+ * mapped into memory and the stream decoded straight into it */
+bool decodeToFile(const char* path, decodeStats* stats);
+
+// one independent encoded stream for decodeBatch
+typedef struct
+{
+    const unsigned char* in; // the encoded stream, as written by encode
+    size_t inLen; // the number of bytes in in
+    
+    unsigned char* out; // malloc'd decoded stream, set by decodeBatch; NULL if
+                        // the stream was invalid
+    size_t outLen; // the number of bytes in out
+    bool ok; // true if the stream was decoded successfully
+} lzwRecord;
+
+/* decodes each of the numRecords records, filling in its out, outLen, and ok
+ * fields. Several records are decoded in lockstep so that the table lookups of
+ * one overlap with those of the others; the result for each record is the same
+ * as decode would give for it. Returns true if every record was valid. */
+bool decodeBatch(lzwRecord* records, size_t numRecords);
 
 #endif
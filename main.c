@@ -8,18 +8,29 @@
  * the appropriate function from lzw.h
  */
 
+#define _POSIX_C_SOURCE 200809L // for clock_gettime
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
 #include <string.h>
 #include <stdbool.h>
+#include <time.h>
 #include "lzw.h"
+#include "filter.h"
+#include "mem.h"
+#include "compress.h"
+#include "trace.h"
 
 // the returns codes from main
 typedef enum
 {
     SUCCESS = 0,
     INVALID_ARGS, // encode or decode was passed invalid args
-    FAILED_DECODE // decode failed because stdin isn't a valid encoded file
+    FAILED_DECODE, // decode failed because stdin isn't a valid encoded file
+    FAILED_OUTPUT, // the file given by -o or --trace couldn't be written
+    FAILED_MEMORY // the stream can't be encoded or decoded within --max-memory
 } RETURN_CODE;
 
 #define INVALID (-1)
@@ -27,7 +38,8 @@ typedef enum
 typedef enum
 {
     ENCODE,
-    DECODE
+    DECODE,
+    VERIFY
 } MODE;
 
 // enumerates the flag types that can be passed to encode
@@ -36,18 +48,45 @@ typedef enum
     M, // -m flag
     P, // -p flag
     E, // -e flag
+    R, // -r flag
+    C, // -c flag
+    T, // -t flag
+    S, // -s flag
+    D, // -d flag
+    X, // -x flag
+    A, // -a flag
+    O, // -o flag
+    K, // -k flag
+    Z, // -Z flag
+    F, // -f flag
+    POLICY, // -P flag
+    MAX_MEMORY, // --max-memory flag
+    TIMINGS, // --timings flag
+    TRACE, // --trace flag
 } FLAG;
 
+// the names accepted by -P, indexed by prunePolicy
+const char* policyNames[NUM_POLICIES] = {"lru", "lfu", "freeze", "reset"};
+
+// the names accepted by -a, indexed by tuneObjective
+const char* objectiveNames[] = {NULL, "speed", "size", "balanced"};
+#define NUM_OBJECTIVES (sizeof(objectiveNames) / sizeof(*objectiveNames))
+
 /* Called when lzw is passed an invalid set of arguments. Prints a message to
  * stderr */
 void argsError()
 {
     fprintf(stderr, "Invalid Arguments: encode [-m MAXBITS] [-p WINDOW] [-e]"
-                    " or decode with no arguments\n");
+                    " [-r] [-c] [-t] [-s] [-d WIDTH] [-x WIDTH]"
+                    " [-P lru|lfu|freeze|reset] [-a speed|size|balanced]"
+                    " [-o FILE] [-k] [-Z] [-f] [--max-memory BYTES]"
+                    " [--timings] [--trace FILE] or decode [-v] [-o FILE]"
+                    " [--max-memory BYTES] [--timings] [--trace FILE] or"
+                    " verify [--max-memory BYTES] [--timings] [--trace FILE]\n");
 }
 
-/* Identifies the given arg as "encode" or "decode". Returns INVALID if the
- * arg is neither "encode" nor "decode" */
+/* Identifies the given arg as "encode", "decode", or "verify". Returns INVALID
+ * if the arg is none of them */
 MODE encodeOrDecode(char* arg)
 {
     char* lastSlash = strrchr(arg, '/');
@@ -64,6 +103,10 @@ MODE encodeOrDecode(char* arg)
     {
         return DECODE;
     }
+    else if(strcmp(arg, "verify") == 0)
+    {
+        return VERIFY;
+    }
     else
     {
         return INVALID;
@@ -86,6 +129,66 @@ FLAG checkFlag(char* arg)
     {
         return E;
     }
+    else if(strcmp(arg, "-r") == 0)
+    {
+        return R;
+    }
+    else if(strcmp(arg, "-c") == 0)
+    {
+        return C;
+    }
+    else if(strcmp(arg, "-t") == 0)
+    {
+        return T;
+    }
+    else if(strcmp(arg, "-s") == 0)
+    {
+        return S;
+    }
+    else if(strcmp(arg, "-d") == 0)
+    {
+        return D;
+    }
+    else if(strcmp(arg, "-x") == 0)
+    {
+        return X;
+    }
+    else if(strcmp(arg, "-a") == 0)
+    {
+        return A;
+    }
+    else if(strcmp(arg, "-o") == 0)
+    {
+        return O;
+    }
+    else if(strcmp(arg, "-k") == 0)
+    {
+        return K;
+    }
+    else if(strcmp(arg, "-Z") == 0)
+    {
+        return Z;
+    }
+    else if(strcmp(arg, "-f") == 0)
+    {
+        return F;
+    }
+    else if(strcmp(arg, "-P") == 0)
+    {
+        return POLICY;
+    }
+    else if(strcmp(arg, "--max-memory") == 0)
+    {
+        return MAX_MEMORY;
+    }
+    else if(strcmp(arg, "--timings") == 0)
+    {
+        return TIMINGS;
+    }
+    else if(strcmp(arg, "--trace") == 0)
+    {
+        return TRACE;
+    }
     else
     {
         return INVALID;
@@ -109,6 +212,124 @@ long checkNumArg(char* arg)
     }
 }
 
+/* Converts the argument following --max-memory, a number of bytes optionally
+ * followed by K, M, or G for that many KiB, MiB, or GiB, to a number of bytes.
+ * Returns 0 if arg is invalid. */
+size_t checkSizeArg(char* arg)
+{
+    char* charAfterNum;
+    long long num = strtoll(arg, &charAfterNum, 10);
+    int shift = 0;
+    
+    switch(*charAfterNum)
+    {
+        case 'K': shift = 10; charAfterNum++; break;
+        case 'M': shift = 20; charAfterNum++; break;
+        case 'G': shift = 30; charAfterNum++; break;
+    }
+    
+    if(*charAfterNum != '\0' || charAfterNum == arg || num <= 0 ||
+       (unsigned long long)num > SIZE_MAX >> shift)
+    {
+        return 0;
+    }
+    
+    return (size_t)num << shift;
+}
+
+/* Converts the argument following -P to a prunePolicy. Returns INVALID if arg
+ * doesn't name a policy. */
+int checkPolicyArg(char* arg)
+{
+    for(int i = 0; i < NUM_POLICIES; i++)
+    {
+        if(strcmp(arg, policyNames[i]) == 0)
+        {
+            return i;
+        }
+    }
+    
+    return INVALID;
+}
+
+/* Converts the argument following -a to a tuneObjective. Returns INVALID if
+ * arg doesn't name an objective. */
+int checkObjectiveArg(char* arg)
+{
+    for(int i = TUNE_NONE + 1; i < NUM_OBJECTIVES; i++)
+    {
+        if(strcmp(arg, objectiveNames[i]) == 0)
+        {
+            return i;
+        }
+    }
+    
+    return INVALID;
+}
+
+/* Checks that the file at path, given by -o, can be written, creating it if it
+ * doesn't exist. Prints a message to stderr and returns false if it can't. */
+bool checkOutPath(char* path)
+{
+    FILE* file = fopen(path, "wb");
+    if(!file)
+    {
+        fprintf(stderr, "Cannot write to %s\n", path);
+        return false;
+    }
+    
+    fclose(file);
+    return true;
+}
+
+// for --max-memory, prints the peak memory used to stderr
+void reportMemory()
+{
+    fprintf(stderr,
+            "peak memory: %zu bytes resident, %zu bytes of tables and"
+            " buffers (limit %zu bytes)\n",
+            memPeakResident(),
+            memPeak(),
+            memLimit());
+}
+
+/* for --timings and --trace, starts timing the phases of encode or decode if
+ * either was given. Prints a message to stderr and returns false if the trace
+ * file at tracePath can't be written. */
+bool startTiming(bool timings, char* tracePath)
+{
+    if((timings || tracePath) && !traceStart(tracePath))
+    {
+        fprintf(stderr, "Cannot write to %s\n", tracePath);
+        return false;
+    }
+    
+    return true;
+}
+
+/* stops timing the phases, printing their histograms to stderr for --timings.
+ * Prints a message to stderr and returns false if the trace file at tracePath
+ * couldn't be written. */
+bool finishTiming(bool timings, char* tracePath)
+{
+    if((timings || tracePath) && !traceFinish(timings))
+    {
+        fprintf(stderr, "Cannot write to %s\n", tracePath);
+        return false;
+    }
+    
+    return true;
+}
+
+// returns the time in seconds since some fixed point
+double seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 /* Processes the command line arguments and calls the appropriate function from
  * lzw.h */
 int main(int argc, char** argv)
@@ -121,27 +342,171 @@ int main(int argc, char** argv)
         argsError();
         return INVALID_ARGS;
     }
+    else if(mode == VERIFY)
+    {
+        size_t maxMemory = 0; // value of --max-memory argument, or 0
+        bool timings = false; // true if --timings has been seen
+        char* tracePath = NULL; // value of --trace argument, or NULL
+        
+        // iterate over args
+        for(unsigned int i = 1; i < argc; i++)
+        {
+            FLAG argType = checkFlag(argv[i]);
+            if(argType == MAX_MEMORY && i + 1 < argc &&
+               (maxMemory = checkSizeArg(argv[++i])) > 0)
+            {
+                memSetLimit(maxMemory);
+            }
+            else if(argType == TIMINGS)
+            {
+                timings = true;
+            }
+            else if(argType == TRACE && i + 1 < argc)
+            {
+                tracePath = argv[++i];
+            }
+            else
+            {
+                argsError();
+                return INVALID_ARGS;
+            }
+        }
+        
+        if(!startTiming(timings, tracePath))
+        {
+            return FAILED_OUTPUT;
+        }
+        
+        decodeStats stats;
+        double start = seconds();
+        bool verified = verify(&stats);
+        double elapsed = seconds() - start;
+        
+        if(!finishTiming(timings, tracePath))
+        {
+            return FAILED_OUTPUT;
+        }
+        
+        if(!verified)
+        {
+            if(stats.overLimit)
+            {
+                fprintf(stderr, "Cannot verify within --max-memory\n");
+                return FAILED_MEMORY;
+            }
+            fprintf(stderr, "Error on verify; invalid encoded stream\n");
+            return FAILED_DECODE;
+        }
+        
+        fprintf(stderr,
+                "OK: %llu bytes, %llu checksums, %.3f s (%.1f MB/s)\n",
+                stats.bytes,
+                stats.checks,
+                elapsed,
+                (elapsed > 0) ? stats.bytes / elapsed / 1e6 : 0.0);
+        if(maxMemory) reportMemory();
+    }
     else if(mode == DECODE)
     {
-        if(argc > 1) // decode cannot have additional args
+        bool vFlag = false; // true if -v flag has been seen, to print stats
+        char* outPath = NULL; // value of -o argument, or NULL if there's no -o
+        size_t maxMemory = 0; // value of --max-memory argument, or 0 if
+                              // there's no --max-memory
+        bool timings = false; // true if --timings has been seen
+        char* tracePath = NULL; // value of --trace argument, or NULL
+        
+        // iterate over args
+        for(unsigned int i = 1; i < argc; i++)
         {
-            argsError();
-            return INVALID_ARGS;
+            if(strcmp(argv[i], "-v") == 0)
+            {
+                vFlag = true;
+            }
+            else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            {
+                outPath = argv[++i];
+            }
+            else if(checkFlag(argv[i]) == MAX_MEMORY && i + 1 < argc &&
+                    (maxMemory = checkSizeArg(argv[++i])) > 0)
+            {
+                memSetLimit(maxMemory);
+            }
+            else if(checkFlag(argv[i]) == TIMINGS)
+            {
+                timings = true;
+            }
+            else if(checkFlag(argv[i]) == TRACE && i + 1 < argc)
+            {
+                tracePath = argv[++i];
+            }
+            else
+            {
+                argsError();
+                return INVALID_ARGS;
+            }
+        }
+        
+        if((outPath && !checkOutPath(outPath)) ||
+           !startTiming(timings, tracePath))
+        {
+            return FAILED_OUTPUT;
+        }
+        
+        decodeStats stats;
+        bool decoded = (outPath) ? decodeToFile(outPath, &stats)
+                                 : decode(&stats);
+        
+        if(!finishTiming(timings, tracePath))
+        {
+            return FAILED_OUTPUT;
         }
-        else
+        
+        if(!decoded)
         {
-            if(!decode())
+            if(stats.overLimit)
             {
-                fprintf(stderr, "Error on decode; invalid encoded stream\n");
-                return FAILED_DECODE;
+                fprintf(stderr, "Cannot decode within --max-memory\n");
+                return FAILED_MEMORY;
             }
+            fprintf(stderr, "Error on decode; invalid encoded stream\n");
+            return FAILED_DECODE;
+        }
+        
+        if(vFlag)
+        {
+            fprintf(stderr,
+                    "codes: %llu, hot-string cache hits: %llu (%.1f%%)\n",
+                    stats.codes,
+                    stats.cacheHits,
+                    (stats.codes) ? 100.0 * stats.cacheHits / stats.codes
+                                  : 0.0);
         }
+        if(maxMemory) reportMemory();
     }
     else // mode == ENCODE
     {
         long maxBits = 0; // value of -m argument, or 0 if there's no -m
         long window = 0; // value of -p argument, or 0 if there's no -p
         bool eFlag = false; // true if -e flag has been seen
+        bool rFlag = false; // true if -r flag has been seen
+        bool cFlag = false; // true if -c flag has been seen
+        bool tFlag = false; // true if -t flag has been seen
+        bool sFlag = false; // true if -s flag has been seen
+        bool kFlag = false; // true if -k flag has been seen
+        bool zFlag = false; // true if -Z flag has been seen
+        bool fFlag = false; // true if -f flag has been seen
+        unsigned int filters = 0; // the filters given by -d and -x
+        long filterWidth = 0; // value of -d or -x argument, or 0 if there's
+                              // neither
+        int policy = INVALID; // value of -P argument, or INVALID if there's no
+                              // -P
+        int tune = TUNE_NONE; // value of -a argument, or TUNE_NONE if there's
+                              // no -a
+        char* outPath = NULL; // value of -o argument, or NULL if there's no -o
+        size_t maxMemory = 0; // value of --max-memory argument, or 0 if
+                              // there's no --max-memory
+        bool timings = false; // true if --timings has been seen
+        char* tracePath = NULL; // value of --trace argument, or NULL
         
         // iterate over args
         for(unsigned int i = 1; i < argc; i++)
@@ -162,41 +527,239 @@ int main(int argc, char** argv)
                     {
                         // maxBits is a positive int; now set to correct value
                         // if out of range
-                        if(maxBits <= 8 || maxBits > 24)
+                        if(maxBits < MIN_MAXBITS || maxBits > MAX_MAXBITS)
                         {
                             maxBits = 12;
                         }
                     }
                     break;
-                    
+                
                 case P:
                     i++;
                     if(i >= argc || // there is no following number arg
-                       (window = checkNumArg(argv[i])) <= 0)
+                       (window = checkNumArg(argv[i])) <= 0 ||
+                       window > UINT_MAX)
                     {
                         argsError();
                         return 1;
                     }
                     break;
-                    
+                
                 case E:
                     eFlag = true;
                     break;
+                
+                case R:
+                    rFlag = true;
+                    break;
+                
+                case C:
+                    cFlag = true;
+                    break;
+                
+                case T:
+                    tFlag = true;
+                    break;
+                
+                case S:
+                    sFlag = true;
+                    break;
+                
+                case K:
+                    kFlag = true;
+                    break;
+                
+                case Z:
+                    zFlag = true;
+                    break;
+                
+                case F:
+                    fFlag = true;
+                    break;
+                
+                case D:
+                case X:
+                {
+                    unsigned int filter = (argType == D) ? FILTER_DELTA :
+                                                           FILTER_SHUFFLE;
+                    long width;
+                    
+                    i++;
+                    if(i >= argc || // there is no following number arg
+                       (width = checkNumArg(argv[i])) <= 0 ||
+                       !filterWidthValid(filter, width) ||
+                       // -d and -x must agree on the width
+                       (filterWidth && width != filterWidth))
+                    {
+                        argsError();
+                        return 1;
+                    }
                     
+                    filters |= filter;
+                    filterWidth = width;
+                    break;
+                }
+                
+                case A:
+                    i++;
+                    if(i >= argc || // there is no following objective arg
+                       (tune = checkObjectiveArg(argv[i])) == INVALID)
+                    {
+                        argsError();
+                        return 1;
+                    }
+                    break;
+                
+                case O:
+                    i++;
+                    if(i >= argc) // there is no following file arg
+                    {
+                        argsError();
+                        return 1;
+                    }
+                    outPath = argv[i];
+                    break;
+                
+                case POLICY:
+                    i++;
+                    if(i >= argc || // there is no following policy arg
+                       (policy = checkPolicyArg(argv[i])) == INVALID)
+                    {
+                        argsError();
+                        return 1;
+                    }
+                    break;
+                
+                case MAX_MEMORY:
+                    i++;
+                    if(i >= argc || // there is no following size arg
+                       (maxMemory = checkSizeArg(argv[i])) == 0)
+                    {
+                        argsError();
+                        return 1;
+                    }
+                    break;
+                
+                case TIMINGS:
+                    timings = true;
+                    break;
+                
+                case TRACE:
+                    i++;
+                    if(i >= argc) // there is no following file arg
+                    {
+                        argsError();
+                        return 1;
+                    }
+                    tracePath = argv[i];
+                    break;
+                
                 default:
                     argsError();
                     return 1;
             }
         }
         
-        if(!maxBits) // if maxBits wasn't set, default to 12
+        // -a chooses maxBits, window, and eFlag itself
+        if(tune != TUNE_NONE && (maxBits || window || eFlag))
+        {
+            argsError();
+            return 1;
+        }
+        
+        // -Z writes compress's format, which has none of the other options,
+        // and codes of no more than Z_MAX_BITS
+        if(zFlag && (window || eFlag || rFlag || cFlag || tFlag || sFlag ||
+                     kFlag || fFlag || filters || policy != INVALID ||
+                     tune != TUNE_NONE || maxBits > Z_MAX_BITS))
         {
-            maxBits = 12;
+            argsError();
+            return 1;
+        }
+        
+        // -a runs its trials side by side, which a limit can't allow for
+        if(tune != TUNE_NONE && maxMemory)
+        {
+            argsError();
+            return 1;
         }
         
-        encode(maxBits, window, eFlag);
+        // if maxBits wasn't set, default to 12, or under --max-memory to the
+        // largest table that fits (and for -Z, to compress's default)
+        if(!maxBits)
+        {
+            maxBits = (zFlag) ? Z_MAX_BITS : (maxMemory) ? MAX_MAXBITS : 12;
+        }
+        
+        if(policy == INVALID) // if policy wasn't set, default to lru
+        {
+            policy = POLICY_LRU;
+        }
+        else if(prunePolicyUsesWindow(policy) && !window && !tune)
+        {
+            // this policy would never prune without -p
+            argsError();
+            return 1;
+        }
+        
+        // -f parses the input differently only once the table is full and
+        // frozen, which it never is if it's pruned or reset, and it needs
+        // every single-char string in it, which -e (or -a, which may choose
+        // -e and -p) doesn't ensure
+        if(fFlag && (eFlag || cFlag || tune != TUNE_NONE ||
+                     pruneInfoPolicy(policy, window) != POLICY_FREEZE))
+        {
+            argsError();
+            return 1;
+        }
+        
+        encodeOptions options;
+        options.maxBits = maxBits;
+        options.window = window;
+        options.eFlag = eFlag;
+        options.rFlag = rFlag;
+        options.cFlag = cFlag;
+        options.policy = policy;
+        options.tFlag = tFlag;
+        options.sFlag = sFlag;
+        options.filters = filters;
+        options.filterWidth = filterWidth;
+        options.tune = tune;
+        options.length = -1;
+        options.kFlag = kFlag;
+        options.zFlag = zFlag;
+        options.fFlag = fFlag;
+        
+        // -o writes to a file, and records the length of the input so that
+        // decode -o can preallocate its output
+        if(outPath)
+        {
+            if(!checkOutPath(outPath) || !freopen(outPath, "wb", stdout))
+            {
+                return FAILED_OUTPUT;
+            }
+            options.length = inputLength();
+        }
+        
+        memSetLimit(maxMemory);
+        if(maxMemory && !encodeFitMemory(&options))
+        {
+            fprintf(stderr, "Cannot encode within --max-memory\n");
+            return FAILED_MEMORY;
+        }
+        
+        if(!startTiming(timings, tracePath))
+        {
+            return FAILED_OUTPUT;
+        }
+        encode(&options);
+        if(!finishTiming(timings, tracePath))
+        {
+            return FAILED_OUTPUT;
+        }
+        if(maxMemory) reportMemory();
     }
-
+    
     return SUCCESS;
 }
 
@@ -0,0 +1,158 @@
+/* 
+ * File:   mem.c
+ * Author: Alexander Schurman (alexander.schurman@yale.edu)
+ * 
+ * Created on October 18, 2026
+ * 
+ * Implementation of mem.h. Each allocation is preceded by a header holding its
+ * size, so that memFree and memRealloc know how many bytes they give back.
+ */
+
+#define _POSIX_C_SOURCE 200809L // for getrusage
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include "mem.h"
+
+// the bytes the process holds outside of memory from memAlloc and friends
+// while encoding or decoding: stdio buffers, the blocks kept on the stack,
+// the entropy coders, and the -t thread's stack
+#define MEM_OVERHEAD (1 << 20)
+
+// a further 1/MEM_SLACK_DIVISOR of the limit is left for the heap's own
+// overhead and fragmentation
+#define MEM_SLACK_DIVISOR (16)
+
+// precedes each allocation; the union keeps what follows suitably aligned
+typedef union
+{
+    size_t size; // the bytes asked for
+    long double ld;
+    long long ll;
+    void* ptr;
+} memHeader;
+
+static size_t memInUse = 0; // the bytes held now
+static size_t memMost = 0; // the most bytes held at once
+static size_t memMax = 0; // the limit, or 0
+static pthread_mutex_t memLock = PTHREAD_MUTEX_INITIALIZER; // guards the above
+
+/* counts the bytes of an allocation of newSize bytes replacing one of oldSize
+ * bytes, which are both held while the allocation is made */
+void memCount(size_t oldSize, size_t newSize)
+{
+    pthread_mutex_lock(&memLock);
+    memInUse += newSize;
+    if(memInUse > memMost)
+    {
+        memMost = memInUse;
+    }
+    memInUse -= oldSize;
+    pthread_mutex_unlock(&memLock);
+}
+
+void* memAlloc(size_t size)
+{
+    memHeader* header = malloc(sizeof(memHeader) + size);
+    if(!header)
+    {
+        return NULL;
+    }
+    
+    header->size = size;
+    memCount(0, size);
+    
+    return header + 1;
+}
+
+void* memCalloc(size_t num, size_t size)
+{
+    memHeader* header = calloc(1, sizeof(memHeader) + num * size);
+    if(!header)
+    {
+        return NULL;
+    }
+    
+    header->size = num * size;
+    memCount(0, num * size);
+    
+    return header + 1;
+}
+
+void* memRealloc(void* ptr, size_t size)
+{
+    if(!ptr)
+    {
+        return memAlloc(size);
+    }
+    
+    memHeader* header = (memHeader*)ptr - 1;
+    size_t oldSize = header->size;
+    
+    header = realloc(header, sizeof(memHeader) + size);
+    if(!header)
+    {
+        return NULL;
+    }
+    
+    header->size = size;
+    memCount(oldSize, size);
+    
+    return header + 1;
+}
+
+void memFree(void* ptr)
+{
+    if(!ptr)
+    {
+        return;
+    }
+    
+    memHeader* header = (memHeader*)ptr - 1;
+    memCount(header->size, 0);
+    free(header);
+}
+
+size_t memPeak()
+{
+    pthread_mutex_lock(&memLock);
+    size_t peak = memMost;
+    pthread_mutex_unlock(&memLock);
+    
+    return peak;
+}
+
+size_t memPeakResident()
+{
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+    
+    return (size_t)usage.ru_maxrss * 1024; // ru_maxrss is in kilobytes
+}
+
+void memSetLimit(size_t limit)
+{
+    memMax = limit;
+}
+
+size_t memLimit()
+{
+    return memMax;
+}
+
+size_t memAvailable()
+{
+    if(memMax == 0)
+    {
+        return SIZE_MAX;
+    }
+    
+    size_t held = memPeakResident() + MEM_OVERHEAD + memMax / MEM_SLACK_DIVISOR;
+    
+    return (held < memMax) ? memMax - held : 0;
+}
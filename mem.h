@@ -0,0 +1,43 @@
+/* 
+ * File:   mem.h
+ * Author: Alexander Schurman
+ * 
+ * Created on October 18, 2026
+ * 
+ * Interface for --max-memory: allocation functions that keep count of the
+ * bytes held by the string tables and everything else that grows with maxBits,
+ * and the limit that encode and decode keep their peak memory under.
+ */
+
+#include <stddef.h>
+
+#ifndef MEM_H
+#define MEM_H
+
+/* malloc, calloc, realloc, and free, keeping count of the bytes held. Memory
+ * from the first three must be freed with memFree, and memory from anything
+ * else must not be. Can be called from several threads at once. */
+void* memAlloc(size_t size);
+void* memCalloc(size_t num, size_t size);
+void* memRealloc(void* ptr, size_t size);
+void memFree(void* ptr);
+
+// returns the most bytes held at once by memory from the functions above
+size_t memPeak();
+
+// returns the peak resident memory of the process so far, in bytes
+size_t memPeakResident();
+
+/* sets the most resident memory the process may reach (--max-memory), in
+ * bytes, or 0 for no limit */
+void memSetLimit(size_t limit);
+
+// returns the limit set by memSetLimit, or 0 if there is none
+size_t memLimit();
+
+/* returns how many bytes memory from the functions above may reach at once
+ * without the process going over the limit, given what it holds already and
+ * what it holds outside of them, or SIZE_MAX if there is no limit */
+size_t memAvailable();
+
+#endif
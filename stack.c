@@ -11,24 +11,25 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include "stack.h"
+#include "mem.h"
 
 #define INIT_STACK_SIZE (20)
 #define STACK_GROWTH_FACTOR (2)
 
 stack* stackNew()
 {
-    stack* st = malloc(sizeof(stack));
+    stack* st = memAlloc(sizeof(stack));
     st->dataLen = 0;
     st->dataSize = INIT_STACK_SIZE;
-    st->data = malloc(sizeof(unsigned char) * INIT_STACK_SIZE);
+    st->data = memAlloc(sizeof(unsigned char) * INIT_STACK_SIZE);
     
     return st;
 }
 
 void stackDelete(stack* st)
 {
-    free(st->data);
-    free(st);
+    memFree(st->data);
+    memFree(st);
 }
 
 void stackPush(stack* st, unsigned char c)
@@ -37,7 +38,7 @@ void stackPush(stack* st, unsigned char c)
     if(st->dataLen == st->dataSize)
     {
         st->dataSize *= STACK_GROWTH_FACTOR;
-        st->data = realloc(st->data, sizeof(unsigned char) * st->dataSize);
+        st->data = memRealloc(st->data, sizeof(unsigned char) * st->dataSize);
     }
     
     st->dataLen++;
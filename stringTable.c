@@ -11,7 +11,16 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <pthread.h>
 #include "stringTable.h"
+#include "mem.h"
+#include "trace.h"
+
+// the number of tableElts first malloc'd for a table (unless it can't hold as
+// many); array grows from here as codes are added. Kept small, since many
+// streams may be decoded at once (see decodeBatch) and short ones never need
+// more.
+#define INIT_ALLOC_SIZE (1 << 9)
 
 /*******************************************************************************
 ********************************* Misc. Functions ******************************
@@ -22,7 +31,63 @@ unsigned int hashFunc(unsigned int prefix,
                       unsigned char appendChar,
                       unsigned int hashtableSize)
 {
-    return (prefix << 8 | appendChar) % hashtableSize;
+    return ((unsigned long long)prefix << 8 | appendChar) % hashtableSize;
+}
+
+/* returns the first code in table->hash. Every table without -e starts with
+ * the same strings, the single chars, at the same codes, so they are found
+ * from their code instead of being hashed again in every table */
+unsigned int firstHashedCode(const stringTable* table)
+{
+    return (table->eFlag) ? table->firstCode : table->firstCode + 256;
+}
+
+// mallocs table->hash with room for twice table->allocSize codes and puts
+// every code in the table from firstHashedCode on into it
+void buildHash(stringTable* table)
+{
+    table->hashSize = (table->allocSize * 2) + 1;
+    table->hash = memAlloc(sizeof(unsigned int) * (size_t)table->hashSize);
+    
+    // initialize table->hash to EMPTY_SLOT so we know which hash entries are
+    // occupied
+    for(unsigned int i = 0; i < table->hashSize; i++)
+    {
+        table->hash[i] = EMPTY_SLOT;
+    }
+    
+    for(unsigned int code = firstHashedCode(table);
+        code <= table->highestCode;
+        code++)
+    {
+        tableElt* elt = &(table->array[code]);
+        unsigned int hashIndex = hashFunc(elt->prefix, elt->k, table->hashSize);
+        
+        while(table->hash[hashIndex] != EMPTY_SLOT)
+        {
+            hashIndex = (hashIndex + 1) % table->hashSize;
+        }
+        
+        table->hash[hashIndex] = code;
+    }
+}
+
+// doubles the malloc'd size of table->array (up to table->arraySize) and
+// rebuilds table->hash to match
+void growTable(stringTable* table)
+{
+    unsigned long long begin = traceBegin();
+    
+    table->allocSize = (table->allocSize > table->arraySize / 2) ?
+                       table->arraySize :
+                       table->allocSize * 2;
+    table->array = memRealloc(table->array,
+                              sizeof(tableElt) * (size_t)table->allocSize);
+    
+    memFree(table->hash);
+    buildHash(table);
+    
+    traceEnd(TRACE_GROW, begin);
 }
 
 /* returns true if the tableElt's prefix and c fields match prefix and
@@ -56,6 +121,11 @@ bool stringTableAdd(stringTable* table,
         return false;   
     }
     
+    if(table->highestCode + 1 == table->allocSize)
+    {
+        growTable(table);
+    }
+    
     table->highestCode++;
     
     // the arrayIndex is also the code for the new entry, since table->array
@@ -69,12 +139,12 @@ bool stringTableAdd(stringTable* table,
     table->array[arrayIndex].code = arrayIndex;
     
     // find the first empty entry in the hash table
-    while(table->hash[hashIndex] != NULL)
+    while(table->hash[hashIndex] != EMPTY_SLOT)
     {
         hashIndex = (hashIndex + 1) % table->hashSize;
     }
     
-    table->hash[hashIndex] = &(table->array[arrayIndex]);
+    table->hash[hashIndex] = arrayIndex;
     
     if(code) *code = arrayIndex;
     return true;
@@ -90,36 +160,36 @@ void stringTableInit(stringTable* table)
 {
     if(table->eFlag == false)
     {
+        // they're not put in the hash; see firstHashedCode
         for(unsigned int i = 0; i <= 255; i++)
         {
-            stringTableAdd(table, EMPTY_PREFIX, i, NULL);
-        }   
+            tableElt* elt = &(table->array[table->firstCode + i]);
+            elt->prefix = EMPTY_PREFIX;
+            elt->k = i;
+            elt->code = table->firstCode + i;
+        }
+        table->highestCode = table->firstCode + 255;
     }
 }
 
-// creates new table based on the number of possible codes and the values from
-// the -p and -e args; window is 0 if no -p was passed
+// creates new table based on the number of possible codes, the number of
+// special codes, and the value from the -e arg
 stringTable* createTable(unsigned int numCodes,
+                         unsigned int firstCode,
                          bool eFlag)
 {
-    stringTable* table = malloc(sizeof(stringTable));
+    stringTable* table = memAlloc(sizeof(stringTable));
     
-    table->highestCode = NUM_SPECIAL_CODES - 1;
+    table->firstCode = firstCode;
+    table->highestCode = firstCode - 1;
     
     table->eFlag = eFlag;
     
     table->arraySize = numCodes;
-    table->array = malloc(sizeof(tableElt) * table->arraySize);
+    table->allocSize = (numCodes < INIT_ALLOC_SIZE) ? numCodes : INIT_ALLOC_SIZE;
+    table->array = memAlloc(sizeof(tableElt) * (size_t)table->allocSize);
     
-    table->hashSize = (table->arraySize * 2) + 1;
-    table->hash = malloc(sizeof(tableElt*) * table->hashSize);
-    
-    // initialize table->hash to NULL pointers so we know which hash entries
-    // are occupied
-    for(unsigned int i = 0; i < table->hashSize; i++)
-    {
-        table->hash[i] = NULL;
-    }
+    buildHash(table);
     
     stringTableInit(table);
     
@@ -127,16 +197,27 @@ stringTable* createTable(unsigned int numCodes,
 }
 
 stringTable* stringTableNew(unsigned int maxBits,
+                            unsigned int firstCode,
                             bool eFlag)
 {
-    return createTable((1 << maxBits), eFlag);
+    return createTable((1 << maxBits), firstCode, eFlag);
+}
+
+void stringTableReset(stringTable* table)
+{
+    table->highestCode = table->firstCode - 1;
+    memset(table->hash,
+           EMPTY_SLOT,
+           sizeof(unsigned int) * (size_t)table->hashSize);
+    
+    stringTableInit(table);
 }
 
 void stringTableDelete(stringTable* table)
 {
-    free(table->array);
-    free(table->hash);
-    free(table);
+    memFree(table->array);
+    memFree(table->hash);
+    memFree(table);
 }
 
 
@@ -148,29 +229,36 @@ tableElt* stringTableHashSearch(stringTable* table,
                                 unsigned int prefix,
                                 unsigned char appendChar)
 {
+    if(prefix == EMPTY_PREFIX && !table->eFlag)
+    {
+        return &(table->array[table->firstCode + appendChar]);
+    }
+    
     unsigned int hashIndex = hashFunc(prefix, appendChar, table->hashSize);
     
-    // increment hashIndex (mod hashSize) until we reach NULL or the desired
-    // entry
-    while(table->hash[hashIndex] != NULL &&
-          !tableEltMatch(prefix, appendChar, table->hash[hashIndex]))
+    // increment hashIndex (mod hashSize) until we reach EMPTY_SLOT or the
+    // desired entry
+    while(table->hash[hashIndex] != EMPTY_SLOT &&
+          !tableEltMatch(prefix,
+                         appendChar,
+                         &(table->array[table->hash[hashIndex]])))
     {
         hashIndex = (hashIndex + 1) % table->hashSize;
     }
     
-    if(table->hash[hashIndex] == NULL)
+    if(table->hash[hashIndex] == EMPTY_SLOT)
     {
         return NULL;
     }
     else
     {
-        return table->hash[hashIndex];
+        return &(table->array[table->hash[hashIndex]]);
     }
 }
 
 tableElt* stringTableCodeSearch(stringTable* table, unsigned int code)
 {
-    if(code > table->highestCode || code < NUM_SPECIAL_CODES)
+    if(code > table->highestCode || code < table->firstCode)
     {
         return NULL;
     }
@@ -182,16 +270,67 @@ tableElt* stringTableCodeSearch(stringTable* table, unsigned int code)
 
 
 /*******************************************************************************
-******************************** Pruning ***************************************
+**************************** Pruning Policies **********************************
 *******************************************************************************/
 
+// the operations that make up a pruning policy
+typedef struct policyOps policyOps;
+struct policyOps
+{
+    // true if the policy prunes only when a window is given
+    bool usesWindow;
+    
+    // updates pi's bookkeeping when code is seen
+    void (*sawCode)(pruneInfo* pi, unsigned int code);
+    
+    // prunes table as described for stringTablePrune; NULL if the policy
+    // never prunes
+    stringTable* (*prune)(stringTable* table,
+                          pruneInfo* pi,
+                          unsigned long window,
+                          unsigned int* codeToUpdate,
+                          const policyOps* ops);
+    
+    // for policies that prune with rebuildTable: prepares oldPi to choose codes
+    // from table, then decides whether each code in turn should be kept, then
+    // gives the bookkeeping each kept code carries into the new table
+    void (*startRebuild)(pruneInfo* oldPi,
+                         stringTable* table,
+                         unsigned long window);
+    bool (*keepCode)(pruneInfo* oldPi, unsigned int code, unsigned long window);
+    unsigned long (*carrySeen)(unsigned long seen);
+};
+
+// grows pi->seen, if need be, so that it has an entry for code
+void pruneInfoFit(pruneInfo* pi, unsigned int code)
+{
+    if(code < pi->numCodes)
+    {
+        return;
+    }
+    
+    unsigned int oldNumCodes = pi->numCodes;
+    while(pi->numCodes <= code)
+    {
+        pi->numCodes = (pi->numCodes > pi->maxCodes / 2) ? pi->maxCodes :
+                                                           pi->numCodes * 2;
+    }
+    
+    pi->seen = memRealloc(pi->seen,
+                          sizeof(unsigned long) * (size_t)pi->numCodes);
+    memset(&pi->seen[oldNumCodes],
+           0,
+           sizeof(unsigned long) * (size_t)(pi->numCodes - oldNumCodes));
+}
+
 // adds a tableElt and all it's prefixes from an old stringTable to a new
 // stringTable. Returns the code of eltToAdd in the new table
 unsigned int recursiveAdd(stringTable* newTable,
                           stringTable* oldTable,
                           const tableElt* eltToAdd,
                           pruneInfo* oldPi,
-                          pruneInfo* newPi)
+                          pruneInfo* newPi,
+                          const policyOps* ops)
 {    
     unsigned int newPrefix = EMPTY_PREFIX;
     unsigned int oldPrefix = eltToAdd->prefix;
@@ -202,90 +341,510 @@ unsigned int recursiveAdd(stringTable* newTable,
                                  oldTable,
                                  stringTableCodeSearch(oldTable, oldPrefix),
                                  oldPi,
-                                 newPi);
+                                 newPi,
+                                 ops);
     }
     
     unsigned int newCode;
     stringTableAdd(newTable, newPrefix, eltToAdd->k, &newCode);
     
     // update newPi
-    newPi->lastSeen[newCode] = oldPi->lastSeen[eltToAdd->code];
+    pruneInfoFit(newPi, newCode);
+    newPi->seen[newCode] = ops->carrySeen(oldPi->seen[eltToAdd->code]);
     
     return newCode;
 }
 
-stringTable* stringTablePrune(stringTable* table,
-                              pruneInfo* pi,
-                              unsigned long window,
-                              unsigned int* codeToUpdate)
+/* builds a new table out of the codes in table that the policy chooses to
+ * keep, along with their prefixes, giving them their bookkeeping from oldPi in
+ * newPi. codeToUpdate may be NULL */
+stringTable* rebuildFrom(stringTable* table,
+                         pruneInfo* oldPi,
+                         pruneInfo* newPi,
+                         unsigned long window,
+                         unsigned int* codeToUpdate,
+                         const policyOps* ops)
 {
-    // copy pi into oldPi
-    pruneInfo* oldPi = malloc(sizeof(pruneInfo));
-    oldPi->counter = pi->counter;
-    oldPi->lastSeen = malloc(sizeof(unsigned long) * table->arraySize);
-    for(unsigned int i = 0; i < table->arraySize; i++)
-    {
-        oldPi->lastSeen[i] = pi->lastSeen[i];
-    }
-    
-    // reinitialize pi->lastSeen to zero
-    memset(pi->lastSeen, 0, sizeof(unsigned long) * table->arraySize);
-    
     stringTable* newTable = createTable(table->arraySize,
+                                        table->firstCode,
                                         table->eFlag);
     
-    for(unsigned int i = NUM_SPECIAL_CODES; i <= table->highestCode; i++)
+    ops->startRebuild(oldPi, table, window);
+    
+    for(unsigned int i = table->firstCode; i <= table->highestCode; i++)
     {
         tableElt* oldElt = &(table->array[i]);
         
-        if(oldPi->lastSeen[i] > oldPi->counter - window)
+        if(ops->keepCode(oldPi, i, window))
         {
             unsigned int newCode = recursiveAdd(newTable,
                                                 table,
                                                 oldElt,
                                                 oldPi,
-                                                pi);
+                                                newPi,
+                                                ops);
             
-            if(oldElt->code == *codeToUpdate)
+            if(codeToUpdate && oldElt->code == *codeToUpdate)
             {
                 *codeToUpdate = newCode;
             }
         }
     }
     
+    return newTable;
+}
+
+// returns a malloc'd copy of pi holding the first numCodes entries of seen
+pruneInfo* pruneInfoCopy(pruneInfo* pi, unsigned int numCodes)
+{
+    pruneInfo* copy = memAlloc(sizeof(pruneInfo));
+    *copy = *pi;
+    copy->numCodes = numCodes;
+    copy->seen = memAlloc(sizeof(unsigned long) * (size_t)numCodes);
+    memcpy(copy->seen, pi->seen, sizeof(unsigned long) * (size_t)numCodes);
+    
+    return copy;
+}
+
+/* prunes by building a new table out of the codes the policy chooses to keep,
+ * along with their prefixes */
+stringTable* rebuildTable(stringTable* table,
+                          pruneInfo* pi,
+                          unsigned long window,
+                          unsigned int* codeToUpdate,
+                          const policyOps* ops)
+{
+    // copy pi into oldPi, making sure it covers every code in table
+    pruneInfoFit(pi, table->highestCode);
+    pruneInfo* oldPi = pruneInfoCopy(pi, pi->numCodes);
+    
+    // reinitialize pi->seen to zero
+    memset(pi->seen, 0, sizeof(unsigned long) * (size_t)pi->numCodes);
+    
+    stringTable* newTable = rebuildFrom(table,
+                                        oldPi,
+                                        pi,
+                                        window,
+                                        codeToUpdate,
+                                        ops);
+    
     stringTableDelete(table);
     pruneInfoDelete(oldPi);
     
     return newTable;
 }
 
+// policy operations shared by more than one policy
+void countSawCode(pruneInfo* pi, unsigned int code)
+{
+    (pi->counter)++;
+}
+
+unsigned long keepSeen(unsigned long seen)
+{
+    return seen;
+}
+
+// POLICY_LRU: keep the codes seen in the last window codes
+void lruSawCode(pruneInfo* pi, unsigned int code)
+{
+    pruneInfoFit(pi, code);
+    pi->seen[code] = pi->counter;
+    (pi->counter)++;
+}
+
+void lruStartRebuild(pruneInfo* oldPi, stringTable* table, unsigned long window)
+{
+}
+
+bool lruKeepCode(pruneInfo* oldPi, unsigned int code, unsigned long window)
+{
+    return oldPi->seen[code] > oldPi->counter - window;
+}
+
+// POLICY_LFU: keep the window codes seen most often
+void lfuSawCode(pruneInfo* pi, unsigned int code)
+{
+    pruneInfoFit(pi, code);
+    pi->seen[code]++;
+    (pi->counter)++;
+}
+
+/* returns the rank'th largest (counting from 0) of the numValues values,
+ * reordering them */
+unsigned long selectLargest(unsigned long* values,
+                            unsigned long numValues,
+                            unsigned long rank)
+{
+    unsigned long low = 0, high = numValues;
+    
+    while(true)
+    {
+        unsigned long pivot = values[low + (high - low) / 2];
+        
+        // partition values[low, high) into values larger than pivot, values
+        // equal to it, then values smaller than it
+        unsigned long larger = low, i = low, smaller = high;
+        while(i < smaller)
+        {
+            unsigned long value = values[i];
+            
+            if(value > pivot)
+            {
+                values[i++] = values[larger];
+                values[larger++] = value;
+            }
+            else if(value < pivot)
+            {
+                values[i] = values[--smaller];
+                values[smaller] = value;
+            }
+            else
+            {
+                i++;
+            }
+        }
+        
+        if(rank < larger)
+        {
+            high = larger;
+        }
+        else if(rank >= smaller)
+        {
+            low = smaller;
+        }
+        else
+        {
+            return pivot;
+        }
+    }
+}
+
+void lfuStartRebuild(pruneInfo* oldPi, stringTable* table, unsigned long window)
+{
+    unsigned long numValues = table->highestCode - table->firstCode + 1;
+    
+    oldPi->keepUses = 0;
+    oldPi->tiesLeft = 0;
+    if(window == 0 || numValues == 0)
+    {
+        return;
+    }
+    
+    // find how often the window'th most often seen code was seen
+    unsigned long* uses = memAlloc(sizeof(unsigned long) * numValues);
+    memcpy(uses,
+           &oldPi->seen[table->firstCode],
+           sizeof(unsigned long) * numValues);
+    
+    if(window < numValues)
+    {
+        oldPi->keepUses = selectLargest(uses, numValues, window - 1);
+    }
+    memFree(uses);
+    
+    // every code seen more often is kept, and ties are kept in code order
+    // until there are window codes
+    oldPi->tiesLeft = window;
+    for(unsigned int i = table->firstCode; i <= table->highestCode; i++)
+    {
+        if(oldPi->seen[i] > oldPi->keepUses) oldPi->tiesLeft--;
+    }
+}
+
+bool lfuKeepCode(pruneInfo* oldPi, unsigned int code, unsigned long window)
+{
+    if(oldPi->seen[code] > oldPi->keepUses)
+    {
+        return true;
+    }
+    else if(oldPi->seen[code] == oldPi->keepUses &&
+            oldPi->keepUses > 0 &&
+            oldPi->tiesLeft > 0)
+    {
+        oldPi->tiesLeft--;
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+unsigned long lfuCarrySeen(unsigned long seen)
+{
+    return seen / 2;
+}
+
+// POLICY_RESET: empty the table
+stringTable* resetTable(stringTable* table,
+                        pruneInfo* pi,
+                        unsigned long window,
+                        unsigned int* codeToUpdate,
+                        const policyOps* ops)
+{
+    stringTableReset(table);
+    pruneInfoReset(pi);
+    
+    return table;
+}
+
+// the operations for each policy, indexed by prunePolicy
+const policyOps policies[NUM_POLICIES] =
+{
+    {true, lruSawCode, rebuildTable, lruStartRebuild, lruKeepCode, keepSeen},
+    {true, lfuSawCode, rebuildTable, lfuStartRebuild, lfuKeepCode, lfuCarrySeen},
+    {false, countSawCode, NULL, NULL, NULL, NULL},
+    {false, countSawCode, resetTable, NULL, NULL, NULL}
+};
+
+
+/*******************************************************************************
+******************************** Pruning ***************************************
+*******************************************************************************/
+
+stringTable* stringTablePrune(stringTable* table,
+                              pruneInfo* pi,
+                              unsigned long window,
+                              unsigned int* codeToUpdate)
+{
+    unsigned long long begin = traceBegin();
+    const policyOps* ops = &policies[pi->policy];
+    
+    table = ops->prune(table, pi, window, codeToUpdate, ops);
+    
+    traceEnd(TRACE_PRUNE, begin);
+    return table;
+}
+
+prunePolicy pruneInfoPolicy(prunePolicy policy, unsigned long window)
+{
+    return (window == 0 && policies[policy].usesWindow) ? POLICY_FREEZE : policy;
+}
+
+bool prunePolicyUsesWindow(prunePolicy policy)
+{
+    return policies[policy].usesWindow;
+}
+
 /*******************************************************************************
 ******************************** pruneInfo *************************************
 *******************************************************************************/
 
-// malloc's a new pruneInfo with size based on maxBits
-pruneInfo* pruneInfoNew(unsigned int maxBits)
+// malloc's a new pruneInfo for up to maxCodes codes
+pruneInfo* createPruneInfo(unsigned int maxCodes, prunePolicy policy)
 {
-    pruneInfo* pi = malloc(sizeof(pruneInfo));
-    pi->lastSeen = malloc(sizeof(unsigned long) * (1 << maxBits));
+    pruneInfo* pi = memAlloc(sizeof(pruneInfo));
+    pi->policy = policy;
+    pi->maxCodes = maxCodes;
+    pi->numCodes = (pi->maxCodes < INIT_ALLOC_SIZE) ? pi->maxCodes :
+                                                      INIT_ALLOC_SIZE;
+    pi->seen = memAlloc(sizeof(unsigned long) * (size_t)pi->numCodes);
     pi->counter = 1;
     
-    memset(pi->lastSeen, 0, sizeof(unsigned long) * (1 << maxBits));
+    memset(pi->seen, 0, sizeof(unsigned long) * (size_t)pi->numCodes);
     
     return pi;
 }
 
+// malloc's a new pruneInfo with size based on maxBits
+pruneInfo* pruneInfoNew(unsigned int maxBits, prunePolicy policy)
+{
+    return createPruneInfo(1 << maxBits, policy);
+}
+
 // frees the pruneInfo pi
 void pruneInfoDelete(pruneInfo* pi)
 {
-    free(pi->lastSeen);
-    free(pi);
+    memFree(pi->seen);
+    memFree(pi);
 }
 
-/* sets pi's lastSeen value for code to the current counter, then increments
+/* updates pi's bookkeeping for code according to its policy, then increments
  * the counter */
 void pruneInfoSawCode(pruneInfo* pi, unsigned int code)
 {
-    pi->lastSeen[code] = pi->counter;
-    (pi->counter)++;
-}
\ No newline at end of file
+    policies[pi->policy].sawCode(pi, code);
+}
+
+// forgets every code pi has seen, as after a stringTableReset
+void pruneInfoReset(pruneInfo* pi)
+{
+    pi->counter = 1;
+    memset(pi->seen, 0, sizeof(unsigned long) * (size_t)pi->numCodes);
+}
+
+bool pruneInfoPrunes(pruneInfo* pi, unsigned long window)
+{
+    const policyOps* ops = &policies[pi->policy];
+    
+    return ops->prune != NULL && (window > 0 || !ops->usesWindow);
+}
+
+/*******************************************************************************
+***************************** Background Pruning *******************************
+*******************************************************************************/
+
+struct pruneJob
+{
+    stringTable* snapshot; // copy of the codes to prune from, without a hash
+    pruneInfo* oldPi; // copy of the pruneInfo when snapshot was taken
+    pruneInfo* newPi; // bookkeeping for newTable
+    stringTable* newTable; // the pruned table, once the job is done
+    unsigned long window;
+    
+    bool threaded; // true if the job runs on its own thread
+    pthread_t thread;
+};
+
+// builds job->newTable; the body of the job's thread
+void* pruneJobRun(void* arg)
+{
+    pruneJob* job = arg;
+    unsigned long long begin = traceBegin();
+    
+    job->newTable = rebuildFrom(job->snapshot,
+                                job->oldPi,
+                                job->newPi,
+                                job->window,
+                                NULL,
+                                &policies[job->oldPi->policy]);
+    
+    traceEnd(TRACE_PRUNE_AHEAD, begin);
+    return NULL;
+}
+
+// waits for job to finish, then frees its snapshot
+void pruneJobWait(pruneJob* job)
+{
+    if(job->threaded)
+    {
+        pthread_join(job->thread, NULL);
+    }
+    
+    stringTableDelete(job->snapshot);
+    pruneInfoDelete(job->oldPi);
+}
+
+pruneJob* pruneJobStart(stringTable* table,
+                        pruneInfo* pi,
+                        unsigned long window,
+                        unsigned int lastCode)
+{
+    if(policies[pi->policy].prune != rebuildTable)
+    {
+        return NULL;
+    }
+    
+    pruneJob* job = memAlloc(sizeof(pruneJob));
+    job->window = window;
+    
+    // only the prefixes and chars of the codes are needed to rebuild, so the
+    // snapshot goes without a hash
+    stringTable* snapshot = memAlloc(sizeof(stringTable));
+    *snapshot = *table;
+    snapshot->highestCode = lastCode;
+    snapshot->allocSize = lastCode + 1;
+    snapshot->array = memAlloc(sizeof(tableElt) * (size_t)snapshot->allocSize);
+    memcpy(snapshot->array,
+           table->array,
+           sizeof(tableElt) * (size_t)snapshot->allocSize);
+    snapshot->hash = NULL;
+    snapshot->hashSize = 0;
+    job->snapshot = snapshot;
+    
+    pruneInfoFit(pi, lastCode);
+    job->oldPi = pruneInfoCopy(pi, lastCode + 1);
+    job->newPi = createPruneInfo(pi->maxCodes, pi->policy);
+    
+    // if no thread can be had, prune right away
+    job->threaded = pthread_create(&job->thread, NULL, pruneJobRun, job) == 0;
+    if(!job->threaded)
+    {
+        pruneJobRun(job);
+    }
+    
+    return job;
+}
+
+stringTable* pruneJobFinish(pruneJob* job, stringTable* table, pruneInfo* pi)
+{
+    unsigned long long begin = traceBegin();
+    pruneJobWait(job);
+    stringTable* newTable = job->newTable;
+    
+    // pi keeps counting from where it is, with the kept codes' bookkeeping
+    memFree(pi->seen);
+    pi->seen = job->newPi->seen;
+    pi->numCodes = job->newPi->numCodes;
+    
+    stringTableDelete(table);
+    memFree(job->newPi);
+    memFree(job);
+    
+    traceEnd(TRACE_PRUNE, begin);
+    return newTable;
+}
+
+void pruneJobCancel(pruneJob* job)
+{
+    pruneJobWait(job);
+    
+    stringTableDelete(job->newTable);
+    pruneInfoDelete(job->newPi);
+    memFree(job);
+}
+
+
+/*******************************************************************************
+*********************************** Memory *************************************
+*******************************************************************************/
+
+/* returns the most bytes a table for numCodes codes holds, which is while its
+ * array is being doubled to numCodes from half that, beside the old hash */
+size_t tableMaxMemory(size_t numCodes)
+{
+    return sizeof(stringTable) + sizeof(tableElt) * numCodes * 3 / 2 +
+           sizeof(unsigned int) * (2 * numCodes + 1);
+}
+
+/* returns the most bytes a pruneInfo for numCodes codes holds under policy.
+ * seen grows as codes are seen only for the policies that rebuild */
+size_t pruneInfoMaxMemory(size_t numCodes, prunePolicy policy)
+{
+    if(policies[policy].prune != rebuildTable)
+    {
+        numCodes = (numCodes < INIT_ALLOC_SIZE) ? numCodes : INIT_ALLOC_SIZE;
+        return sizeof(pruneInfo) + sizeof(unsigned long) * numCodes;
+    }
+    
+    return sizeof(pruneInfo) + sizeof(unsigned long) * numCodes * 3 / 2;
+}
+
+size_t stringTableMaxMemory(unsigned int maxBits,
+                            prunePolicy policy,
+                            bool pruneAhead)
+{
+    size_t numCodes = (size_t)1 << maxBits;
+    size_t held = tableMaxMemory(numCodes) +
+                  pruneInfoMaxMemory(numCodes, policy);
+    
+    if(policies[policy].prune != rebuildTable)
+    {
+        return held;
+    }
+    
+    // rebuilding holds a copy of the pruneInfo and the new table beside the
+    // old ones; a job also holds a snapshot of the old array and its own
+    // pruneInfo for the new table
+    held += sizeof(pruneInfo) + sizeof(unsigned long) * numCodes +
+            tableMaxMemory(numCodes);
+    if(pruneAhead)
+    {
+        held += sizeof(pruneJob) + sizeof(stringTable) +
+                sizeof(tableElt) * numCodes +
+                pruneInfoMaxMemory(numCodes, policy);
+    }
+    
+    return held;
+}
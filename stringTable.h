@@ -10,6 +10,7 @@
  */
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #ifndef STRINGTABLE_H
 #define STRINGTABLE_H
@@ -21,10 +22,20 @@ enum
     GROW_NBITS_CODE, // increments the number of bits per code
     PRUNE_CODE, // indicates that the string table has been pruned
     STOP_CODE, // indicates that the encoded file has ended
+    RESET_CODE, // for -c; the string table has been reset to its initial state
+    STORED_CODE, // for -s; a block of bytes follows as they are
+    CHECK_CODE, // for -k; the CRC-32C of the last block follows
     NUM_SPECIAL_CODES // the number of special codes in this enum
 };
 
+/* the number of special codes in streams that use none of the codes after
+ * STOP_CODE. Such streams number their strings from here rather than from
+ * NUM_SPECIAL_CODES so that they match the original format (and streams that
+ * use only some of the later codes number them from just past the last) */
+#define NUM_ORIGINAL_SPECIAL_CODES (RESET_CODE)
+
 #define EMPTY_PREFIX (0)
+#define EMPTY_SLOT (0) // marks unused entries of stringTable->hash
 
 /*******************************************************************************
  ***************************** Struct Definitions ******************************
@@ -41,38 +52,72 @@ typedef struct
 typedef struct
 {
     tableElt* array; // array indexed by tableElt codes for O(1) access by code
-    tableElt** hash; // a hash table that holds pointers to elements of array;
-                     // allows near O(1) access by prefix-char pairs
+    unsigned int* hash; // a hash table that holds the codes of elements of
+                        // array, or EMPTY_SLOT; allows near O(1) access by
+                        // prefix-char pairs
     
-    unsigned int arraySize; // the malloc'd size of array; also the max number
-                            // of tableElts that can be stored
+    unsigned int arraySize; // the max number of tableElts that can be stored
+    unsigned int allocSize; // the malloc'd size of array, which is doubled as
+                            // codes are added until it reaches arraySize
     unsigned int hashSize; // the malloc'd size of hash
     
+    unsigned int firstCode; // the lowest code that isn't a special code
     unsigned int highestCode; // the current number of tableElts stored
     
     bool eFlag; // true if -e was passed to encode
 } stringTable;
 
-/* Used for pruning. Contains when each code was last seen; lastSeen[n] is equal
- * to the counter value when code n was last output by encode or input by
- * decode */
+// the policies that decide which codes survive when a full table is pruned
+typedef enum
+{
+    POLICY_LRU, // keep the codes seen in the last WINDOW codes (the default)
+    POLICY_LFU, // keep the WINDOW codes that have been seen most often
+    POLICY_FREEZE, // never prune; the full table simply stops changing
+    POLICY_RESET, // empty the table back to its initial state
+    NUM_POLICIES // the number of policies in this enum
+} prunePolicy;
+
+/* Used for pruning. Contains the bookkeeping the policy needs for each code;
+ * for POLICY_LRU, seen[n] is equal to the counter value when code n was last
+ * output by encode or input by decode, and for POLICY_LFU it is the number of
+ * times code n has been output or input since it was added (halved at each
+ * prune, so that old favorites fade) */
 typedef struct
 {
-    unsigned long* lastSeen;
-    unsigned long counter;
+    prunePolicy policy;
+    unsigned long* seen;
+    unsigned long counter; // one more than the number of codes seen
+    unsigned int numCodes; // the malloc'd size of seen, which grows as codes
+                           // are seen
+    unsigned int maxCodes; // the most codes seen will need to hold
+    
+    // used by POLICY_LFU while pruning
+    unsigned long keepUses; // codes seen more often than this are kept
+    unsigned long tiesLeft; // how many codes seen exactly keepUses times are
+                            // still to be kept
 } pruneInfo;
 
+// a prune being prepared on another thread from a snapshot of a table
+typedef struct pruneJob pruneJob;
+
 
 /*******************************************************************************
  ***************************** stringTable Functions ***************************
  ******************************************************************************/
 
-/* returns a malloc'd stringTable. maxBits is the -m arg */
-stringTable* stringTableNew(unsigned int maxBits, bool eFlag);
+/* returns a malloc'd stringTable. maxBits is the -m arg; firstCode is the
+ * number of special codes the stream uses */
+stringTable* stringTableNew(unsigned int maxBits,
+                            unsigned int firstCode,
+                            bool eFlag);
 
 // frees the malloc'd stringTable
 void stringTableDelete(stringTable* table);
 
+/* empties the table and refills it as stringTableNew would, without
+ * reallocating it */
+void stringTableReset(stringTable* table);
+
 /* Adds an entry to the string table. Returns true if successful.
  * prefix and c are the prefix code and appended character of the entry.
  * code is a pointer to an unsigned int into which stringTableAdd puts the code
@@ -97,9 +142,11 @@ tableElt* stringTableCodeSearch(stringTable* table, unsigned int code);
 // returns true if table is full and ready to be pruned
 bool stringTableIsFull(stringTable* table);
 
-/* prunes the table by deleting the old table and returning a new one. Modifies
+/* prunes the table according to pi's policy, by deleting the old table and
+ * returning a new one (or, for POLICY_RESET, by resetting it). Modifies
  * codeToUpdate from the old table to the new table (if passed 50, and 50
- * becomes 3 in the pruned table, writes 3 to codeToUpdate).
+ * becomes 3 in the pruned table, writes 3 to codeToUpdate; if the code doesn't
+ * survive, leaves it unchanged).
  * Also updates the codes in the pruneInfo. */
 stringTable* stringTablePrune(stringTable* table,
                               pruneInfo* pi,
@@ -112,13 +159,63 @@ stringTable* stringTablePrune(stringTable* table,
  ******************************************************************************/
 
 // malloc's a new pruneInfo with size based on maxBits
-pruneInfo* pruneInfoNew(unsigned int maxBits);
+pruneInfo* pruneInfoNew(unsigned int maxBits, prunePolicy policy);
 
 // frees the pruneInfo pi
 void pruneInfoDelete(pruneInfo* pi);
 
-/* sets pi's lastSeen value for code to the current counter, then increments
+/* updates pi's bookkeeping for code according to its policy, then increments
  * the counter */
 void pruneInfoSawCode(pruneInfo* pi, unsigned int code);
 
+// forgets every code pi has seen, as after a stringTableReset
+void pruneInfoReset(pruneInfo* pi);
+
+/* returns true if a full table should be pruned under pi's policy with the
+ * given window (the -p arg, or 0 if there was none) */
+bool pruneInfoPrunes(pruneInfo* pi, unsigned long window);
+
+/* returns the policy a pruneInfo should be created with for the given policy
+ * and window: policy itself, unless it would never prune, in which case it is
+ * POLICY_FREEZE so that no bookkeeping is done */
+prunePolicy pruneInfoPolicy(prunePolicy policy, unsigned long window);
+
+/* returns true if pi's policy needs a window. Such policies prune only when a
+ * window is given */
+bool prunePolicyUsesWindow(prunePolicy policy);
+
+
+/*******************************************************************************
+***************************** pruneJob Functions ******************************
+*******************************************************************************/
+
+/* starts building, on another thread, the table that pruning table with
+ * stringTablePrune would give if table held only the codes up to lastCode.
+ * table and pi are copied, so they can go on being used while the job runs.
+ * Returns NULL if pi's policy doesn't prune by rebuilding the table. */
+pruneJob* pruneJobStart(stringTable* table,
+                        pruneInfo* pi,
+                        unsigned long window,
+                        unsigned int lastCode);
+
+/* waits for job to finish, then deletes table and returns the pruned table in
+ * its place. pi gets the kept codes' bookkeeping but keeps its counter. Frees
+ * job. */
+stringTable* pruneJobFinish(pruneJob* job, stringTable* table, pruneInfo* pi);
+
+// waits for job to finish, then frees it and the table it built
+void pruneJobCancel(pruneJob* job);
+
+
+/*******************************************************************************
+********************************* Memory ***************************************
+*******************************************************************************/
+
+/* returns the most bytes (as counted by mem.h) that a table for maxBits, its
+ * pruneInfo under policy, and pruning it (on another thread if pruneAhead)
+ * can hold at once */
+size_t stringTableMaxMemory(unsigned int maxBits,
+                            prunePolicy policy,
+                            bool pruneAhead);
+
 #endif
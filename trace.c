@@ -0,0 +1,251 @@
+/* 
+ * File:   trace.c
+ * Author: Alexander Schurman (alexander.schurman@yale.edu)
+ * 
+ * Created on October 18, 2026
+ * 
+ * Implementation of trace.h. Runs are written to the trace file as they end,
+ * in the JSON format of the Trace Event Profiling Tool, so that nothing grows
+ * with the length of the input.
+ */
+
+#define _POSIX_C_SOURCE 200809L // for clock_gettime
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "trace.h"
+
+// the number of histogram buckets; bucket n counts the runs of 2^n to
+// 2^(n + 1) - 1 nanoseconds
+#define TRACE_BUCKETS (64)
+
+// the most threads told apart in the trace file; any more share the last id
+#define TRACE_MAX_THREADS (64)
+
+// the names of the phases in the report and the trace file, indexed by
+// tracePhase
+static const char* phaseNames[NUM_TRACE_PHASES] =
+    {"read", "code", "unpack", "prune", "prune-ahead", "grow", "write"};
+
+// the runs of a phase
+typedef struct
+{
+    unsigned long long count;
+    unsigned long long total; // in nanoseconds
+    unsigned long long longest; // in nanoseconds
+    unsigned long long buckets[TRACE_BUCKETS];
+} histogram;
+
+static bool tracing = false; // true between traceStart and traceFinish
+static unsigned long long traceZero = 0; // the time traceStart was called
+static histogram histograms[NUM_TRACE_PHASES];
+static FILE* traceFile = NULL; // the trace file, or NULL
+static bool traceFailed = false; // true if a write to traceFile failed
+static unsigned long long traceEvents = 0; // the runs written to traceFile
+static pthread_t threads[TRACE_MAX_THREADS]; // the threads seen, by id
+static unsigned int numThreads = 0;
+static pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER; // guards the
+                                                              // above
+
+// returns the time in nanoseconds since some fixed point
+static unsigned long long now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// returns the id in the trace file of the calling thread; traceLock is held
+static unsigned int threadId()
+{
+    pthread_t self = pthread_self();
+    for(unsigned int i = 0; i < numThreads; i++)
+    {
+        if(pthread_equal(threads[i], self))
+        {
+            return i;
+        }
+    }
+    
+    if(numThreads == TRACE_MAX_THREADS)
+    {
+        return TRACE_MAX_THREADS - 1;
+    }
+    
+    threads[numThreads] = self;
+    return numThreads++;
+}
+
+// returns the bucket of a run of ns nanoseconds
+static unsigned int bucketOf(unsigned long long ns)
+{
+    unsigned int bucket = 0;
+    while(ns > 1)
+    {
+        ns >>= 1;
+        bucket++;
+    }
+    
+    return bucket;
+}
+
+/* returns the duration by which the given fraction of the runs in h had
+ * ended: the top of the bucket holding that run, or the longest run if that
+ * is shorter */
+static unsigned long long percentile(const histogram* h, double fraction)
+{
+    unsigned long long rank = (unsigned long long)(fraction * h->count);
+    if(rank == 0)
+    {
+        rank = 1;
+    }
+    
+    unsigned long long seen = 0;
+    for(unsigned int i = 0; i < TRACE_BUCKETS; i++)
+    {
+        seen += h->buckets[i];
+        if(seen >= rank)
+        {
+            unsigned long long top = (i < TRACE_BUCKETS - 1) ?
+                                     (2ULL << i) - 1 : h->longest;
+            return (top < h->longest) ? top : h->longest;
+        }
+    }
+    
+    return h->longest;
+}
+
+// prints a duration of ns nanoseconds to stderr in a unit that suits it
+static void printDuration(unsigned long long ns)
+{
+    if(ns < 1000ULL)
+    {
+        fprintf(stderr, " %8llu ns", ns);
+    }
+    else if(ns < 1000000ULL)
+    {
+        fprintf(stderr, " %8.1f us", ns / 1e3);
+    }
+    else if(ns < 1000000000ULL)
+    {
+        fprintf(stderr, " %8.1f ms", ns / 1e6);
+    }
+    else
+    {
+        fprintf(stderr, " %8.2f s ", ns / 1e9);
+    }
+}
+
+bool traceStart(const char* path)
+{
+    memset(histograms, 0, sizeof(histograms));
+    traceFailed = false;
+    traceEvents = 0;
+    numThreads = 0;
+    
+    if(path)
+    {
+        traceFile = fopen(path, "w");
+        if(!traceFile)
+        {
+            return false;
+        }
+        fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", traceFile);
+    }
+    
+    traceZero = now();
+    tracing = true;
+    
+    return true;
+}
+
+unsigned long long traceBegin()
+{
+    return (tracing) ? now() : 0;
+}
+
+void traceEnd(tracePhase phase, unsigned long long begin)
+{
+    if(begin == 0)
+    {
+        return;
+    }
+    
+    unsigned long long end = now();
+    unsigned long long ns = end - begin;
+    
+    pthread_mutex_lock(&traceLock);
+    histogram* h = &histograms[phase];
+    h->count++;
+    h->total += ns;
+    h->buckets[bucketOf(ns)]++;
+    if(ns > h->longest)
+    {
+        h->longest = ns;
+    }
+    
+    if(traceFile && !traceFailed)
+    {
+        // times in the file are in microseconds from traceStart
+        if(fprintf(traceFile,
+                   "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                   "\"ts\":%.3f,\"dur\":%.3f}",
+                   (traceEvents > 0) ? "," : "",
+                   phaseNames[phase],
+                   threadId(),
+                   (begin - traceZero) / 1e3,
+                   ns / 1e3) < 0)
+        {
+            traceFailed = true;
+        }
+        traceEvents++;
+    }
+    pthread_mutex_unlock(&traceLock);
+}
+
+bool traceFinish(bool report)
+{
+    tracing = false;
+    
+    if(traceFile)
+    {
+        fputs("\n]}\n", traceFile);
+        if(fclose(traceFile) != 0)
+        {
+            traceFailed = true;
+        }
+        traceFile = NULL;
+    }
+    
+    if(report)
+    {
+        fprintf(stderr,
+                "%-12s %10s %11s %11s %11s %11s\n",
+                "phase",
+                "count",
+                "total",
+                "p50",
+                "p99",
+                "max");
+        for(unsigned int i = 0; i < NUM_TRACE_PHASES; i++)
+        {
+            const histogram* h = &histograms[i];
+            if(h->count == 0)
+            {
+                continue;
+            }
+            
+            fprintf(stderr, "%-12s %10llu", phaseNames[i], h->count);
+            printDuration(h->total);
+            printDuration(percentile(h, 0.5));
+            printDuration(percentile(h, 0.99));
+            printDuration(h->longest);
+            fputc('\n', stderr);
+        }
+    }
+    
+    return !traceFailed;
+}
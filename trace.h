@@ -0,0 +1,48 @@
+/* 
+ * File:   trace.h
+ * Author: Alexander Schurman
+ * 
+ * Created on October 18, 2026
+ * 
+ * Interface for --timings and --trace: the phases of encode and decode are
+ * timed as they run, each run counted in a histogram of durations by powers of
+ * two, and optionally recorded in a trace file for chrome://tracing or
+ * Perfetto.
+ */
+
+#include <stdbool.h>
+
+#ifndef TRACE_H
+#define TRACE_H
+
+// the phases timed
+typedef enum
+{
+    TRACE_READ, // reading a block of input
+    TRACE_CODE, // the dictionary loop over a block
+    TRACE_UNPACK, // unpacking a batch of codes (decode)
+    TRACE_PRUNE, // pruning or resetting the table, or waiting for -t to
+    TRACE_PRUNE_AHEAD, // preparing a pruned table on -t's thread
+    TRACE_GROW, // growing the table
+    TRACE_WRITE, // writing a block of output
+    NUM_TRACE_PHASES
+} tracePhase;
+
+/* starts timing the phases, and if path isn't NULL, recording each run of one
+ * in the file at path. Returns false if the file can't be written. */
+bool traceStart(const char* path);
+
+/* returns the time to pass to traceEnd when a phase begins, or 0 if the
+ * phases aren't being timed */
+unsigned long long traceBegin();
+
+/* counts a run of phase that began at begin (from traceBegin) and ends now,
+ * unless begin is 0. Can be called from several threads at once. */
+void traceEnd(tracePhase phase, unsigned long long begin);
+
+/* stops timing the phases, finishing the trace file if there is one, and if
+ * report, prints the count, total, median, 99th percentile, and longest run of
+ * each phase to stderr. Returns false if the trace file couldn't be written. */
+bool traceFinish(bool report);
+
+#endif
@@ -0,0 +1,271 @@
+/* 
+ * File:   tune.c
+ * Author: Alexander Schurman (alexander.schurman@yale.edu)
+ * 
+ * Created on October 18, 2026
+ * 
+ * Implementation of -a as described in tune.h. The combinations are encoded
+ * on as many threads as there are processors, and each is timed by the CPU
+ * time of its own thread so that they don't slow each other's measurements.
+ */
+
+#define _POSIX_C_SOURCE 200809L // for fseeko, clock_gettime, and sysconf
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "tune.h"
+#include "filter.h"
+
+// a file is sampled in TUNE_NUM_PIECES pieces spread evenly through it
+#define TUNE_NUM_PIECES (4)
+#define TUNE_PIECE_SIZE (TUNE_SAMPLE_SIZE / TUNE_NUM_PIECES)
+
+// maxBits is tried from TUNE_FIRST_MAXBITS up in steps of TUNE_MAXBITS_STEP,
+// as far as the first table the sample is too short to fill; larger tables
+// would compress the sample no differently
+#define TUNE_FIRST_MAXBITS (10)
+#define TUNE_MAXBITS_STEP (2)
+
+// tables the sample can fill are also tried pruned, with a window of
+// 1/TUNE_WINDOW_DIVISOR of the table
+#define TUNE_WINDOW_DIVISOR (4)
+
+// TUNE_SPEED chooses among the combinations whose output is no more than
+// 1/TUNE_SPEED_SLACK larger than the smallest
+#define TUNE_SPEED_SLACK (8)
+
+// the most combinations tried
+#define TUNE_MAX_TRIALS (2 * 2 * ((MAX_MAXBITS - TUNE_FIRST_MAXBITS) / \
+                                  TUNE_MAXBITS_STEP + 1))
+
+/*******************************************************************************
+********************************** Sampling ************************************
+*******************************************************************************/
+
+size_t readSample(unsigned char* sample, bool* replay)
+{
+    struct stat st;
+    off_t start = ftello(stdin);
+    
+    if(fstat(fileno(stdin), &st) == 0 && S_ISREG(st.st_mode) && start >= 0 &&
+       st.st_size - start > TUNE_SAMPLE_SIZE)
+    {
+        off_t span = st.st_size - start - TUNE_PIECE_SIZE;
+        size_t len = 0;
+        
+        for(unsigned int i = 0; i < TUNE_NUM_PIECES; i++)
+        {
+            // keep the pieces aligned to the words the filters treat
+            off_t offset = span / (TUNE_NUM_PIECES - 1) * i;
+            offset -= offset % MAX_FILTER_WIDTH;
+            
+            if(fseeko(stdin, start + offset, SEEK_SET) != 0)
+            {
+                break;
+            }
+            len += fread(&sample[len], 1, TUNE_PIECE_SIZE, stdin);
+        }
+        
+        if(fseeko(stdin, start, SEEK_SET) == 0)
+        {
+            *replay = false;
+            return len;
+        }
+    }
+    
+    *replay = true;
+    return fread(sample, 1, TUNE_SAMPLE_SIZE, stdin);
+}
+
+
+/*******************************************************************************
+*********************************** Trials *************************************
+*******************************************************************************/
+
+// one combination of options and how it did on the sample
+typedef struct
+{
+    encodeOptions options;
+    unsigned long long bits; // the size of the encoded sample
+    double seconds; // the CPU time taken to encode it
+} trial;
+
+// the trials still to be run, shared by the threads running them
+typedef struct
+{
+    trial* trials;
+    unsigned int numTrials;
+    unsigned int next; // the next trial to be run
+    pthread_mutex_t lock; // guards next
+    
+    const unsigned char* sample;
+    size_t len;
+} trialQueue;
+
+// returns the CPU time taken so far by the calling thread, in seconds
+double threadSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// runs trials from the trialQueue at arg until there are none left
+void* runTrials(void* arg)
+{
+    trialQueue* queue = arg;
+    
+    while(true)
+    {
+        pthread_mutex_lock(&queue->lock);
+        unsigned int i = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+        
+        if(i >= queue->numTrials)
+        {
+            return NULL;
+        }
+        
+        trial* t = &queue->trials[i];
+        double start = threadSeconds();
+        t->bits = encodedBits(&t->options, queue->sample, queue->len);
+        t->seconds = threadSeconds() - start;
+    }
+}
+
+/* fills trials with the combinations to try for a sample of len bytes, based
+ * on options, and returns how many there are */
+unsigned int listTrials(trial* trials,
+                        const encodeOptions* options,
+                        size_t len)
+{
+    unsigned int numTrials = 0;
+    
+    for(unsigned int maxBits = TUNE_FIRST_MAXBITS;
+        maxBits <= MAX_MAXBITS;
+        maxBits += TUNE_MAXBITS_STEP)
+    {
+        bool fills = (1UL << maxBits) < len;
+        
+        for(unsigned int pruned = 0; pruned <= fills; pruned++)
+        {
+            for(unsigned int eFlag = 0; eFlag <= 1; eFlag++)
+            {
+                trial* t = &trials[numTrials++];
+                t->options = *options;
+                t->options.maxBits = maxBits;
+                t->options.window = (pruned) ? (1UL << maxBits) /
+                                               TUNE_WINDOW_DIVISOR : 0;
+                t->options.eFlag = eFlag;
+            }
+        }
+        
+        if(!fills)
+        {
+            break;
+        }
+    }
+    
+    return numTrials;
+}
+
+// returns the trial that best meets objective
+trial* bestTrial(trial* trials, unsigned int numTrials, tuneObjective objective)
+{
+    unsigned long long fewestBits = trials[0].bits;
+    for(unsigned int i = 1; i < numTrials; i++)
+    {
+        if(trials[i].bits < fewestBits)
+        {
+            fewestBits = trials[i].bits;
+        }
+    }
+    
+    trial* best = NULL;
+    for(unsigned int i = 0; i < numTrials; i++)
+    {
+        trial* t = &trials[i];
+        bool better;
+        
+        switch(objective)
+        {
+            case TUNE_SPEED:
+                better = t->bits <= fewestBits + fewestBits / TUNE_SPEED_SLACK
+                         && (!best || t->seconds < best->seconds);
+                break;
+            
+            case TUNE_BALANCED:
+                better = !best ||
+                         t->bits * t->seconds < best->bits * best->seconds;
+                break;
+            
+            default: // TUNE_SIZE
+                better = !best || t->bits < best->bits ||
+                         (t->bits == best->bits && t->seconds < best->seconds);
+                break;
+        }
+        
+        if(better)
+        {
+            best = t;
+        }
+    }
+    
+    return best;
+}
+
+void tuneOptions(encodeOptions* options,
+                 const unsigned char* sample,
+                 size_t len)
+{
+    if(len == 0)
+    {
+        return;
+    }
+    
+    trialQueue queue;
+    trial trials[TUNE_MAX_TRIALS];
+    queue.trials = trials;
+    queue.numTrials = listTrials(trials, options, len);
+    queue.next = 0;
+    pthread_mutex_init(&queue.lock, NULL);
+    queue.sample = sample;
+    queue.len = len;
+    
+    long numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if(numThreads < 1)
+    {
+        numThreads = 1;
+    }
+    else if(numThreads > queue.numTrials)
+    {
+        numThreads = queue.numTrials;
+    }
+    
+    // the calling thread runs trials too
+    pthread_t threads[TUNE_MAX_TRIALS];
+    long started = 0;
+    while(started < numThreads - 1 &&
+          pthread_create(&threads[started], NULL, runTrials, &queue) == 0)
+    {
+        started++;
+    }
+    runTrials(&queue);
+    
+    for(long i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&queue.lock);
+    
+    trial* best = bestTrial(trials, queue.numTrials, options->tune);
+    options->maxBits = best->options.maxBits;
+    options->window = best->options.window;
+    options->eFlag = best->options.eFlag;
+}
@@ -0,0 +1,35 @@
+/* 
+ * File:   tune.h
+ * Author: Alexander Schurman
+ * 
+ * Created on October 18, 2026
+ * 
+ * Interface for -a, which chooses encode's maxBits, window, and eFlag by
+ * encoding a sample of the input with several combinations of them and
+ * measuring the size of the output and the time each takes.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "lzw.h"
+
+#ifndef TUNE_H
+#define TUNE_H
+
+#define TUNE_SAMPLE_SIZE (1 << 17) // the most bytes of input that are sampled
+
+/* reads up to TUNE_SAMPLE_SIZE bytes of stdin into sample and returns how many
+ * were read. If stdin is a file longer than that, the sample is taken from
+ * several places spread through it and stdin is rewound, and *replay is set to
+ * false. Otherwise the sample is the start of stdin, which must be encoded
+ * before the rest of it, and *replay is set to true. */
+size_t readSample(unsigned char* sample, bool* replay);
+
+/* sets the maxBits, window, and eFlag of options to the combination that best
+ * meets options->tune in encoding the len bytes at sample. The other options
+ * are used as they are. */
+void tuneOptions(encodeOptions* options,
+                 const unsigned char* sample,
+                 size_t len);
+
+#endif